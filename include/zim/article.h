@@ -21,6 +21,7 @@
 #define ZIM_ARTICLE_H
 
 #include <string>
+#include <vector>
 #include "zim.h"
 #include "blob.h"
 #include <limits>
@@ -34,6 +35,7 @@ namespace zim
 {
   class Cluster;
   class Dirent;
+  class Entry;
   class FileImpl;
 
   class Article
@@ -81,6 +83,7 @@ namespace zim
 
       std::shared_ptr<const Cluster> getCluster() const;
       cluster_index_type getClusterNumber() const;
+      blob_index_type getBlobNumber() const;
 
       Blob getData(offset_type offset=0) const;
       Blob getData(offset_type offset, size_type size) const;
@@ -90,6 +93,13 @@ namespace zim
 
       std::string getPage(bool layout = true, unsigned maxRecurse = 10);
       void getPage(std::ostream&, bool layout = true, unsigned maxRecurse = 10);
+      // The page as a list of blobs, to write them out without copying:
+      // the article data are still backed by their cluster and the layout
+      // literals by the compiled layout page.
+      std::vector<Blob> getPageSegments(bool layout = true, unsigned maxRecurse = 10) const;
+
+      // The article with its directory entry resolved once (see entry.h).
+      Entry getEntry() const;
 
       article_index_type   getIndex() const   { return idx; }
 
@@ -0,0 +1,103 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef ZIM_DIRENT_SCANNER_H
+#define ZIM_DIRENT_SCANNER_H
+
+#include <string>
+#include <memory>
+#include <limits>
+#include "zim.h"
+#include "blob.h"
+#include "article.h"
+
+namespace zim
+{
+  class Dirent;
+  class File;
+  class FileImpl;
+
+  /* Read the directory entries of a file in url order.
+   *
+   * The url pointers and the directory entries are read in large sequential
+   * chunks and parsed in place, without going through the dirent cache.
+   * The scanner is a cursor: the accessors describe the current directory
+   * entry, until the next call to next().
+   *
+   *   DirentScanner scanner(file);
+   *   while (scanner.next()) {
+   *     std::cout << scanner.getLongUrl() << std::endl;
+   *   }
+   */
+  class DirentScanner
+  {
+    public:
+      // Scan the directory entries [begin, end[ (clamped to the file).
+      explicit DirentScanner(const File& file,
+                             article_index_type begin = 0,
+                             article_index_type end = std::numeric_limits<article_index_type>::max(),
+                             size_type chunkSize = 1024*1024);
+      ~DirentScanner();
+
+      // Move to the next directory entry, return false at the end.
+      bool next();
+
+      article_index_type getIndex() const  { return idx; }
+
+      char        getNamespace() const;
+      const std::string& getUrl() const;
+      const std::string& getTitle() const;
+      std::string getLongUrl() const;
+      const std::string& getParameter() const;
+
+      uint16_t    getLibraryMimeType() const;
+      const std::string&  getMimeType() const;
+
+      bool        isRedirect() const;
+      bool        isLinktarget() const;
+      bool        isDeleted() const;
+      bool        isArticle() const;
+
+      article_index_type getRedirectIndex() const;
+      cluster_index_type getClusterNumber() const;
+      blob_index_type getBlobNumber() const;
+
+      Article     getArticle() const  { return Article(impl, idx); }
+
+    private:
+      void readUrlPtrs();
+      void readDirents(offset_type offset, size_type size);
+
+      std::shared_ptr<FileImpl> impl;
+      article_index_type idx;
+      article_index_type end;
+      size_type chunkSize;
+      bool started;
+
+      // The url pointers of [urlPtrsBegin, urlPtrsBegin+urlPtrs.size()/8[.
+      Blob urlPtrs;
+      article_index_type urlPtrsBegin;
+      // The directory entries data starting at direntsOffset.
+      Blob dirents;
+      offset_type direntsOffset;
+
+      std::unique_ptr<Dirent> dirent;
+  };
+
+}
+
+#endif // ZIM_DIRENT_SCANNER_H
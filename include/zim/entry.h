@@ -0,0 +1,92 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef ZIM_ENTRY_H
+#define ZIM_ENTRY_H
+
+#include <string>
+#include <memory>
+#include "zim.h"
+#include "blob.h"
+#include "article.h"
+
+namespace zim
+{
+  class Cluster;
+  class Dirent;
+  class FileImpl;
+
+  /* An article with its directory entry resolved once.
+   *
+   * Each accessor of Article looks the directory entry up again in the
+   * dirent cache. An Entry keeps the directory entry it was created with, so
+   * its accessors are plain reads. pinCluster() also keeps the cluster of the
+   * entry to read its data without going through the cluster cache.
+   *
+   * An Entry must not be modified (pinCluster) while it is used by another
+   * thread.
+   */
+  class Entry
+  {
+    private:
+      std::shared_ptr<FileImpl> file;
+      article_index_type idx;
+      std::shared_ptr<const Dirent> dirent;
+      std::shared_ptr<const Cluster> cluster;
+
+    public:
+      Entry();
+      Entry(std::shared_ptr<FileImpl> file_, article_index_type idx_);
+
+      const std::string& getParameter() const;
+
+      const std::string& getTitle() const;
+      const std::string& getUrl() const;
+      std::string getLongUrl() const;
+
+      uint16_t    getLibraryMimeType() const;
+      const std::string&  getMimeType() const;
+
+      bool        isRedirect() const;
+      bool        isLinktarget() const;
+      bool        isDeleted() const;
+
+      char        getNamespace() const;
+
+      article_index_type   getRedirectIndex() const;
+      Entry       getRedirectEntry() const;
+
+      size_type   getArticleSize() const;
+
+      // Keep the cluster of the entry (if it is an article).
+      Entry&      pinCluster();
+      std::shared_ptr<const Cluster> getCluster() const;
+      cluster_index_type getClusterNumber() const;
+      blob_index_type getBlobNumber() const;
+
+      Blob getData(offset_type offset=0) const;
+      Blob getData(offset_type offset, size_type size) const;
+
+      Article     getArticle() const  { return Article(file, idx); }
+      article_index_type   getIndex() const   { return idx; }
+
+      bool good() const   { return bool(dirent); }
+  };
+
+}
+
+#endif // ZIM_ENTRY_H
@@ -22,7 +22,9 @@
 
 #include <string>
 #include <iterator>
+#include <functional>
 #include <memory>
+#include <vector>
 #include "zim.h"
 #include "article.h"
 #include "blob.h"
@@ -33,11 +35,20 @@ namespace zim
   class Search;
   class FileImpl;
   class Cluster;
+  class DirentScanner;
+  namespace writer
+  {
+    class Transcoder;
+  }
 
   class File
   {
     std::shared_ptr<FileImpl> impl;
 
+    // They read the file below the article level.
+    friend class DirentScanner;
+    friend class writer::Transcoder;
+
     public:
       File()
         { }
@@ -52,6 +63,9 @@ namespace zim
       Article getArticle(article_index_type idx) const;
       Article getArticle(char ns, const std::string& url) const;
       Article getArticleByUrl(const std::string& url) const;
+      // Look several urls up at once, walking the dirents in url order once.
+      // The articles are in the order of the urls, Article() if not found.
+      std::vector<Article> findBatch(const std::vector<std::string>& urls) const;
       Article getArticleByTitle(article_index_type idx) const;
       Article getArticleByTitle(char ns, const std::string& title) const;
       Article getArticleByClusterOrder(article_index_type idx) const;
@@ -59,14 +73,55 @@ namespace zim
       std::shared_ptr<const Cluster> getCluster(cluster_index_type idx) const;
       cluster_index_type getCountClusters() const;
       offset_type getClusterOffset(cluster_index_type idx) const;
+      // The cluster as stored in the file (info byte and compressed content).
+      Blob getRawCluster(cluster_index_type idx) const;
 
       Blob getBlob(cluster_index_type clusterIdx, blob_index_type blobIdx) const;
       offset_type getOffset(cluster_index_type clusterIdx, blob_index_type blobIdx) const;
 
+      // Number of cluster accesses served from (or missing) the cluster cache.
+      size_type getClusterCacheHits() const;
+      size_type getClusterCacheMisses() const;
+      // The same for the cache of the compressed clusters bytes, used when a
+      // compressed cluster is not in the cluster cache, and its size in bytes.
+      size_type getCompressedClusterCacheHits() const;
+      size_type getCompressedClusterCacheMisses() const;
+      size_type getCompressedClusterCacheSize() const;
+
+      // Write the indexes of the clusters and dirents in the caches to path
+      // (a small text file), to warm the caches up after a restart.
+      void saveCacheState(const std::string& path) const;
+      // Preload the clusters and dirents saved by saveCacheState in a
+      // background thread. An access to a cluster being preloaded waits for
+      // it. Return false (and preload nothing) if path is not a cache state
+      // of this zim file. Throw std::runtime_error if the thread cannot be
+      // started.
+      bool loadCacheState(const std::string& path);
+      // Wait for the end of the preload started by loadCacheState.
+      void waitCacheState();
+
+      // The maximum number of dirents and of (uncompressed) clusters in the
+      // caches of this file, and the maximum size in bytes of its compressed
+      // clusters cache. Reducing a size evicts the entries over it right away.
+      size_type getDirentCacheMaxSize() const;
+      void setDirentCacheMaxSize(size_type nbDirents);
+      size_type getClusterCacheMaxSize() const;
+      void setClusterCacheMaxSize(size_type nbClusters);
+      size_type getCompressedClusterCacheMaxSize() const;
+      void setCompressedClusterCacheMaxSize(size_type nbBytes);
+
       article_index_type getNamespaceBeginOffset(char ch) const;
       article_index_type getNamespaceEndOffset(char ch) const;
       article_index_type getNamespaceCount(char ns) const;
 
+      // Call callback with each article (not redirect, ...) and its data.
+      // The clusters are shared between nbThreads threads, each cluster is
+      // uncompressed once, without the cluster cache. The callback is called
+      // concurrently from these threads. An exception thrown by the callback
+      // stops the iteration and is thrown again by parallelForEach.
+      typedef std::function<void(const Article&, const Blob&)> ForEachCallback;
+      void parallelForEach(ForEachCallback callback, unsigned nbThreads = 4) const;
+
       std::string getNamespaces() const;
       bool hasNamespace(char ch) const;
 
@@ -94,6 +149,16 @@ namespace zim
       bool is_multiPart() const;
   };
 
+  // The cache sizes of the files opened afterwards. They default to the
+  // ZIM_DIRENTCACHE, ZIM_CLUSTERCACHE and ZIM_COMPRESSEDCLUSTERCACHE env
+  // variables, or to the build options.
+  void setDefaultDirentCacheMaxSize(size_type nbDirents);
+  size_type getDefaultDirentCacheMaxSize();
+  void setDefaultClusterCacheMaxSize(size_type nbClusters);
+  size_type getDefaultClusterCacheMaxSize();
+  void setDefaultCompressedClusterCacheMaxSize(size_type nbBytes);
+  size_type getDefaultCompressedClusterCacheMaxSize();
+
   std::string urldecode(const std::string& url);
 
 }
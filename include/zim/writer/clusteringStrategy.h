@@ -0,0 +1,103 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef ZIM_WRITER_CLUSTERINGSTRATEGY_H
+#define ZIM_WRITER_CLUSTERINGSTRATEGY_H
+
+#include <string>
+#include <zim/zim.h>
+#include <zim/writer/article.h>
+
+namespace zim
+{
+  namespace writer
+  {
+    /* A ClusteringStrategy decides in which cluster the articles are put.
+     *
+     * Articles with the same group key are put together in the same clusters
+     * (compressed and uncompressed articles are never mixed).
+     * A cluster is closed when isFull returns true for the next article of
+     * its group.
+     *
+     * The default strategy puts all articles in the same group and closes a
+     * cluster when it would grow over the chunk size set on the creator.
+     */
+    class ClusteringStrategy
+    {
+      public:
+        virtual ~ClusteringStrategy() = default;
+
+        virtual std::string getGroupKey(const Article* article) const;
+
+        /* clusterSize and blobCount describe the cluster before the article
+         * of size articleSize is added. chunkSize is the minChunkSize of the
+         * creator (in bytes).
+         */
+        virtual bool isFull(zim::size_type clusterSize,
+                            zim::size_type blobCount,
+                            zim::size_type articleSize,
+                            zim::size_type chunkSize) const;
+    };
+
+    // Put articles of the same mimetype together.
+    class MimetypeClusteringStrategy : public ClusteringStrategy
+    {
+      public:
+        virtual std::string getGroupKey(const Article* article) const;
+    };
+
+    /* Put articles sharing the same namespace and the same first `depth`
+     * components of their url (separated by '/') together.
+     * With a depth of 0, articles are grouped by namespace only.
+     */
+    class UrlPrefixClusteringStrategy : public ClusteringStrategy
+    {
+      public:
+        explicit UrlPrefixClusteringStrategy(unsigned depth = 1)
+          : depth(depth)
+        {}
+        virtual std::string getGroupKey(const Article* article) const;
+
+      private:
+        unsigned depth;
+    };
+
+    /* Close clusters when they reach targetSize bytes (the chunk size of the
+     * creator is ignored) or when they contain maxBlobCount blobs.
+     * A maxBlobCount of 0 means no limit.
+     */
+    class SizeClusteringStrategy : public ClusteringStrategy
+    {
+      public:
+        SizeClusteringStrategy(zim::size_type targetSize,
+                               zim::size_type maxBlobCount)
+          : targetSize(targetSize),
+            maxBlobCount(maxBlobCount)
+        {}
+        virtual bool isFull(zim::size_type clusterSize,
+                            zim::size_type blobCount,
+                            zim::size_type articleSize,
+                            zim::size_type chunkSize) const;
+
+      private:
+        zim::size_type targetSize;
+        zim::size_type maxBlobCount;
+    };
+  }
+}
+
+#endif // ZIM_WRITER_CLUSTERINGSTRATEGY_H
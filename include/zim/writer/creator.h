@@ -20,16 +20,80 @@
 #ifndef ZIM_WRITER_CREATOR_H
 #define ZIM_WRITER_CREATOR_H
 
+#include <array>
+#include <chrono>
+#include <functional>
+#include <map>
 #include <memory>
 #include <zim/zim.h>
 #include <zim/writer/article.h>
+#include <zim/writer/clusteringStrategy.h>
 
 namespace zim
 {
   class Fileheader;
+  class File;
   namespace writer
   {
     class CreatorData;
+
+    /* A snapshot of the progress of a Creator.
+     * Times are in seconds. Compression and indexing times are summed over
+     * all the worker threads.
+     */
+    struct CreatorStats
+    {
+      struct CompressionStats
+      {
+        cluster_index_type clusters = 0;
+        zim::size_type rawSize = 0;
+        zim::size_type compressedSize = 0;
+      };
+      // ratioHistogram[i] is the number of compressed clusters with a
+      // compression ratio in [2^i, 2^(i+1)). The first bucket also counts
+      // ratios below 1, the last one all the bigger ratios.
+      typedef std::array<cluster_index_type, 8> RatioHistogram;
+
+      double elapsedTime = 0;
+
+      // Articles added.
+      article_index_type articles = 0;
+      article_index_type redirectArticles = 0;
+      article_index_type compressedArticles = 0;
+      article_index_type uncompressedArticles = 0;
+      article_index_type fileArticles = 0;
+      article_index_type dedupArticles = 0;
+      article_index_type reusedArticles = 0;
+      zim::size_type articlesSize = 0;
+
+      // Clusters closed, compressed and written.
+      cluster_index_type clusters = 0;
+      cluster_index_type compressedClusters = 0;
+      cluster_index_type uncompressedClusters = 0;
+      cluster_index_type copiedClusters = 0;
+      cluster_index_type writtenClusters = 0;
+      zim::size_type writtenSize = 0;
+      double compressionTime = 0;
+      double writingTime = 0;
+      // By compression, for the compressed clusters written.
+      std::map<CompressionType, CompressionStats> compressions;
+      RatioHistogram ratioHistogram = RatioHistogram();
+
+      // Indexing.
+      article_index_type indexArticles = 0;
+      article_index_type indexedArticles = 0;
+      double indexingTime = 0;
+
+      // Queues.
+      size_t waitingTasks = 0;
+      size_t waitingClusters = 0;
+      zim::size_type bytesInFlight = 0;
+
+      // Part of the time the worker threads spent compressing or indexing.
+      unsigned workerThreads = 0;
+      double workerUtilisation = 0;
+    };
+
     class Creator
     {
       public:
@@ -42,12 +106,71 @@ namespace zim
         { withIndex = indexing; indexingLanguage = language; }
         DEPRECATED void setCompressionThreads(unsigned ct) { nbWorkerThreads = ct; }
         void setNbWorkerThreads(unsigned ct) { nbWorkerThreads = ct; }
+        /* Compress the content of the clusters while they are filled instead
+         * of compressing them once full. Compression is then done in the thread
+         * calling addArticle. Each such cluster holds an encoder, so only a
+         * few clusters are compressed this way at the same time, the other
+         * ones are compressed once full.
+         * Zim files created this way cannot be read by older libzim versions.
+         */
+        void setStreamingCompression(bool streaming) { streamingCompression = streaming; }
+        /* Set how articles are grouped in clusters.
+         * By default, articles are put in clusters in the order they are added.
+         */
+        void setClusteringStrategy(std::shared_ptr<ClusteringStrategy> strategy)
+        { clusteringStrategy = strategy; }
+        /* Store the content shared by several articles only once.
+         * The content of each article is hashed and articles with the same
+         * content point to the same blob.
+         */
+        void setDeduplication(bool dedup) { deduplication = dedup; }
+        /* Set the parameters of the compression.
+         * With adaptive compression, the compression level is lowered when
+         * the compression workers are too slow to follow the articles added
+         * and raised back (up to the level of the options) when they are idle.
+         */
+        void setCompressionOptions(const CompressionOptions& options, bool adaptive = false)
+        { compressionOptions = options; adaptiveCompression = adaptive; }
+        /* Create the zim file as a new version of base.
+         * The content of the articles is compared with the content of the
+         * articles of base with the same url. Base clusters whose content is
+         * all reused are copied as they are, without being recompressed.
+         * Other reused content is put in new clusters.
+         * To compare the content, a base cluster is uncompressed (and its
+         * blobs hashed) the first time an article has the url and the size
+         * of one of its articles. Base clusters no article matches are never
+         * uncompressed.
+         */
+        void setDeltaBase(const File& base);
+        /* Limit the memory (in bytes) held by the clusters not written yet,
+         * being filled or waiting to be compressed or written, raw and
+         * compressed content included. addArticle blocks when the limit is
+         * reached, until the writer frees memory.
+         * By default (0), the number of waiting clusters is limited instead.
+         */
+        void setMaxBytesInFlight(zim::size_type bytes) { maxBytesInFlight = bytes; }
+        /* Call callback with the stats of the creator every period, from
+         * the threads adding articles (without any lock held), and once at
+         * the end of finishZimCreation.
+         */
+        typedef std::function<void(const CreatorStats&)> StatsCallback;
+        void setStatsCallback(StatsCallback callback, std::chrono::milliseconds period)
+        { statsCallback = callback; statsPeriod = period; }
 
 
         virtual void startZimCreation(const std::string& fname);
+        /* Articles can be added by several threads at the same time.
+         * All the calls must be finished before calling finishZimCreation.
+         */
         virtual void addArticle(std::shared_ptr<Article> article);
         virtual void finishZimCreation();
 
+        /* Can be called from any thread once startZimCreation has returned
+         * (and before the creator is destroyed or started again). It does
+         * not wait for the producers or the workers.
+         */
+        CreatorStats getStats() const;
+
         virtual Url getMainUrl() const { return Url(); }
         virtual Url getLayoutUrl() const { return Url(); }
         virtual zim::Uuid getUuid() const { return Uuid::generate(); }
@@ -60,6 +183,15 @@ namespace zim
         size_t minChunkSize = 1024-64;
         std::string indexingLanguage;
         unsigned nbWorkerThreads = 4;
+        bool streamingCompression = false;
+        bool deduplication = false;
+        CompressionOptions compressionOptions;
+        bool adaptiveCompression = false;
+        std::shared_ptr<ClusteringStrategy> clusteringStrategy;
+        std::shared_ptr<const File> deltaBase;
+        zim::size_type maxBytesInFlight = 0;
+        StatsCallback statsCallback;
+        std::chrono::milliseconds statsPeriod = std::chrono::milliseconds(0);
 
         void fillHeader(Fileheader* header) const;
         void write() const;
@@ -0,0 +1,60 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef ZIM_WRITER_TRANSCODER_H
+#define ZIM_WRITER_TRANSCODER_H
+
+#include <string>
+#include <zim/zim.h>
+
+namespace zim
+{
+  class File;
+  namespace writer
+  {
+    /* Write a copy of a zim file with its compressed clusters recompressed
+     * with another compression (or other compression options).
+     *
+     * Clusters are recompressed in parallel by the worker threads and written
+     * in their original order. Articles, clusters and the directory entries
+     * are kept as they are: only the cluster pointers change.
+     * Uncompressed clusters are copied as they are.
+     */
+    class Transcoder
+    {
+      public:
+        explicit Transcoder(CompressionType c, bool verbose = false)
+          : compression(c),
+            verbose(verbose)
+        {}
+
+        void setNbWorkerThreads(unsigned ct) { nbWorkerThreads = ct; }
+        void setCompressionOptions(const CompressionOptions& options)
+        { compressionOptions = options; }
+
+        void transcode(const File& source, const std::string& fname) const;
+
+      private:
+        const CompressionType compression;
+        bool verbose;
+        unsigned nbWorkerThreads = 4;
+        CompressionOptions compressionOptions;
+    };
+  }
+}
+
+#endif // ZIM_WRITER_TRANSCODER_H
@@ -56,7 +56,30 @@ namespace zim
     zimcompZip,
     zimcompBzip2, // Not supported anymore in the libzim
     zimcompLzma,
-    zimcompZstd
+    zimcompZstd,
+    zimcompZstdDict // Zstd with a dictionary stored in the zim file
+  };
+
+  /* Parameters of the compression used by the writer.
+   * Default values keep the default compression of libzim.
+   */
+  struct CompressionOptions
+  {
+    // Compression level (negative for the default level).
+    int level = -1;
+
+    // Log2 of the window (zstd) or dictionary (lzma) size, or of the
+    // window size of zlib (between 9 and 15). 0 for the default size.
+    // Zstd decoders cannot read windows over 2^27 bytes by default.
+    unsigned windowLog = 0;
+
+    // Zstd only: look for matches far in the past.
+    bool longDistanceMatching = false;
+
+    // Zstd only: number of threads used to compress a cluster (0 to
+    // compress in the calling thread). Ignored if zstd is not built with
+    // multithreading support.
+    unsigned nbWorkers = 0;
   };
 
   static const char MimeHtmlTemplate[] = "text/x-zim-htmltemplate";
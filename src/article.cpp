@@ -18,16 +18,18 @@
  */
 
 #include <zim/article.h>
+#include <zim/entry.h>
 #include "template.h"
 #include "_dirent.h"
 #include "cluster.h"
+#include "buffer.h"
 #include <zim/fileheader.h>
 #include "fileimpl.h"
 #include "file_part.h"
-#include <sstream>
 #include <iostream>
 #include <stdexcept>
 #include <limits>
+#include <algorithm>
 #include "log.h"
 
 log_define("zim.article")
@@ -37,69 +39,93 @@ namespace zim
   size_type Article::getArticleSize() const
   {
     auto dirent = getDirent();
-    return size_type(file->getCluster(dirent->getClusterNumber())
-                         ->getBlobSize(dirent->getBlobNumber()));
+    return size_type(file->getBlobSize(dirent->getClusterNumber(),
+                                       dirent->getBlobNumber()));
   }
 
   namespace
   {
-    class Ev : public TemplateParser::Event
+    Blob textBlob(const std::string& text)
     {
-        std::ostream& out;
-        Article& article;
-        std::shared_ptr<FileImpl> file;
-        unsigned maxRecurse;
-
-      public:
-        Ev(std::ostream& out_, Article& article_, std::shared_ptr<FileImpl> file_, unsigned maxRecurse_)
-          : out(out_),
-            article(article_),
-            file(file_),
-            maxRecurse(maxRecurse_)
-          { }
-        void onData(const std::string& data);
-        void onToken(const std::string& token);
-        void onLink(char ns, const std::string& title);
-    };
-
-    void Ev::onData(const std::string& data)
-    {
-      out << data;
+      auto buffer = std::make_shared<MemoryBuffer>(zsize_t(text.size()));
+      std::copy(text.begin(), text.end(), buffer->buf());
+      return Blob(buffer);
     }
 
-    void Ev::onToken(const std::string& token)
+    void appendPage(std::vector<Blob>& segments, const Article& article,
+                    std::shared_ptr<FileImpl> file, bool layout,
+                    unsigned maxRecurse);
+
+    void renderTemplate(std::vector<Blob>& segments, const Article& article,
+                        std::shared_ptr<FileImpl> file,
+                        const CompiledTemplate& compiled, unsigned maxRecurse)
     {
-      log_trace("onToken(\"" << token << "\")");
-
-      if (token == "title")
-        out << article.getTitle();
-      else if (token == "url")
-        out << article.getUrl();
-      else if (token == "namespace")
-        out << article.getNamespace();
-      else if (token == "content")
-      {
-        if (maxRecurse <= 0)
-          throw std::runtime_error("maximum recursive limit is reached");
-        article.getPage(out, false, maxRecurse - 1);
-      }
-      else
-      {
-        log_warn("unknown token \"" << token  << "\" found in template");
-        out << "<%" << token << "%>";
+      for (auto& segment: compiled.getSegments()) {
+        switch (segment.type) {
+          case CompiledTemplate::DATA:
+            // The literal buffer is shared: the blob does not depend on the
+            // template staying in the cache.
+            segments.push_back(Blob(segment.literal));
+            break;
+          case CompiledTemplate::TOKEN:
+            switch (segment.token) {
+              case CompiledTemplate::TITLE:
+                segments.push_back(textBlob(article.getTitle()));
+                break;
+              case CompiledTemplate::URL:
+                segments.push_back(textBlob(article.getUrl()));
+                break;
+              case CompiledTemplate::NAMESPACE:
+                segments.push_back(textBlob(std::string(1, article.getNamespace())));
+                break;
+              case CompiledTemplate::CONTENT:
+                if (maxRecurse <= 0)
+                  throw std::runtime_error("maximum recursive limit is reached");
+                appendPage(segments, article, file, false, maxRecurse - 1);
+                break;
+              default:
+                log_warn("unknown token \"" << segment.data  << "\" found in template");
+                segments.push_back(textBlob("<%" + segment.data + "%>"));
+            }
+            break;
+          case CompiledTemplate::LINK:
+            if (maxRecurse <= 0)
+              throw std::runtime_error("maximum recursive limit is reached");
+            if (!segment.found) {
+              throw std::runtime_error(std::string("impossible to find article ") + std::string(1, segment.ns) + std::string("/") + segment.data);
+            }
+            appendPage(segments, Article(file, segment.index), file, false, maxRecurse - 1);
+            break;
+        }
       }
     }
 
-    void Ev::onLink(char ns, const std::string& url)
+    void appendPage(std::vector<Blob>& segments, const Article& article,
+                    std::shared_ptr<FileImpl> file, bool layout,
+                    unsigned maxRecurse)
     {
-      if (maxRecurse <= 0)
-        throw std::runtime_error("maximum recursive limit is reached");
-      std::pair<bool, article_index_t> r = file->findx(ns, url);
-      if (r.first) {
-          Article(file, article_index_type(r.second)).getPage(out, false, maxRecurse - 1);
-      } else {
-          throw std::runtime_error(std::string("impossible to find article ") + std::string(1, ns) + std::string("/") + url);
+      const std::string& mimeType = article.getMimeType();
+      if (mimeType.compare(0, 9, "text/html") == 0 || mimeType == MimeHtmlTemplate)
+      {
+        if (layout && file->getFileheader().hasLayoutPage())
+        {
+          // The layout page is compiled once for the file.
+          auto compiled = file->getTemplate(article_index_t(file->getFileheader().getLayoutPage()));
+          renderTemplate(segments, article, file, *compiled, maxRecurse);
+          return;
+        }
+        else if (mimeType == MimeHtmlTemplate)
+        {
+          auto compiled = file->getTemplate(article_index_t(article.getIndex()));
+          renderTemplate(segments, article, file, *compiled, maxRecurse);
+          return;
+        }
       }
+
+      // default case - template cases has return above
+      auto data = article.getData();
+      if (data.size())
+        segments.push_back(data);
     }
 
   }
@@ -109,6 +135,14 @@ namespace zim
     return file->getDirent(article_index_t(idx));
   }
 
+  Entry Article::getEntry() const
+  {
+    if (!good()) {
+      return Entry();
+    }
+    return Entry(file, idx);
+  }
+
   std::string Article::getParameter() const
   {
     return getDirent()->getParameter();
@@ -184,11 +218,23 @@ namespace zim
     }
     return dirent->getClusterNumber().v;
 }
+  blob_index_type Article::getBlobNumber() const {
+    auto dirent= getDirent();
+    if ( !dirent->isArticle() ) {
+      return std::numeric_limits<blob_index_type>::max();
+    }
+    return dirent->getBlobNumber().v;
+  }
 
   Blob Article::getData(offset_type offset) const
   {
-    auto size = getArticleSize()-offset;
-    return getData(offset, size);
+    std::shared_ptr<const Cluster> cluster = getCluster();
+    if (!cluster) {
+      return Blob();
+    }
+    // The cluster is uncompressed anyway, take the size from it.
+    auto blobNumber = getDirent()->getBlobNumber();
+    return cluster->getBlob(blobNumber, offset_t(offset), cluster->getBlobSize(blobNumber));
   }
 
   Blob Article::getData(offset_type offset, size_type size) const
@@ -232,49 +278,31 @@ namespace zim
     return std::make_pair(part->filename(), offset_type(local_offset));
   }
 
+  std::vector<Blob> Article::getPageSegments(bool layout, unsigned maxRecurse) const
+  {
+    log_trace("Article::getPageSegments(" << layout << ", " << maxRecurse << ')');
+    std::vector<Blob> segments;
+    appendPage(segments, *this, file, layout, maxRecurse);
+    return segments;
+  }
+
   std::string Article::getPage(bool layout, unsigned maxRecurse)
   {
-    std::ostringstream s;
-    getPage(s, layout, maxRecurse);
-    return s.str();
+    auto segments = getPageSegments(layout, maxRecurse);
+    size_type size = 0;
+    for (auto& segment: segments)
+      size += segment.size();
+    std::string page;
+    page.reserve(size);
+    for (auto& segment: segments)
+      page.append(segment.data(), segment.size());
+    return page;
   }
 
   void Article::getPage(std::ostream& out, bool layout, unsigned maxRecurse)
   {
-    log_trace("Article::getPage(" << layout << ", " << maxRecurse << ')');
-
-    if (getMimeType().compare(0, 9, "text/html") == 0 || getMimeType() == MimeHtmlTemplate)
-    {
-      if (layout && file->getFileheader().hasLayoutPage())
-      {
-        Article layoutPage(file, file->getFileheader().getLayoutPage());
-        Blob data = layoutPage.getData();
-
-        Ev ev(out, *this, file, maxRecurse);
-        log_debug("call template parser");
-        TemplateParser parser(&ev);
-        for (const char* p = data.data(); p != data.end(); ++p)
-          parser.parse(*p);
-        parser.flush();
-
-        return;
-      }
-      else if (getMimeType() == MimeHtmlTemplate)
-      {
-        Blob data = getData();
-
-        Ev ev(out, *this, file, maxRecurse);
-        TemplateParser parser(&ev);
-        for (const char* p = data.data(); p != data.end(); ++p)
-          parser.parse(*p);
-        parser.flush();
-
-        return;
-      }
-    }
-
-    // default case - template cases has return above
-    out << getData();
+    for (auto& segment: getPageSegments(layout, maxRecurse))
+      out << segment;
   }
 
 }
@@ -2,8 +2,10 @@
 
 #include "envvalue.h"
 
+#include <algorithm>
 #include <stdexcept>
 #include <zlib.h>
+#include <zdict.h>
 
 const std::string LZMA_INFO::name = "lzma";
 void LZMA_INFO::init_stream_decoder(stream_t* stream, char* raw_data)
@@ -17,14 +19,38 @@ void LZMA_INFO::init_stream_decoder(stream_t* stream, char* raw_data)
 }
 
 void LZMA_INFO::init_stream_encoder(stream_t* stream, char* raw_data)
+{
+  init_stream_encoder(stream, raw_data, zim::CompressionOptions());
+}
+
+void LZMA_INFO::init_stream_encoder(stream_t* stream, char* raw_data, const zim::CompressionOptions& options)
 {
   *stream = LZMA_STREAM_INIT;
-  auto errcode = lzma_easy_encoder(stream, 9 | LZMA_PRESET_EXTREME, LZMA_CHECK_CRC32);
+  uint32_t preset = options.level < 0
+                  ? default_level() | LZMA_PRESET_EXTREME
+                  : std::min<uint32_t>(options.level, 9);
+  lzma_options_lzma lzmaOptions;
+  if (lzma_lzma_preset(&lzmaOptions, preset)) {
+    throw std::runtime_error("Invalid lzma preset");
+  }
+  if (options.windowLog) {
+    lzmaOptions.dict_size = std::max<uint32_t>(LZMA_DICT_SIZE_MIN, 1U << std::min(options.windowLog, 30U));
+  }
+  lzma_filter filters[] = {
+    { LZMA_FILTER_LZMA2, &lzmaOptions },
+    { LZMA_VLI_UNKNOWN, nullptr }
+  };
+  auto errcode = lzma_stream_encoder(stream, filters, LZMA_CHECK_CRC32);
   if (errcode != LZMA_OK) {
-    throw std::runtime_error("Cannot initialize lzma_easy_encoder");
+    throw std::runtime_error("Cannot initialize lzma_stream_encoder");
   }
 }
 
+int LZMA_INFO::default_level()
+{
+  return 9;
+}
+
 CompStatus LZMA_INFO::stream_run_encode(stream_t* stream, CompStep step) {
   return stream_run(stream, step);
 }
@@ -55,6 +81,11 @@ void LZMA_INFO::stream_end_encode(stream_t* stream)
   lzma_end(stream);
 }
 
+size_t LZMA_INFO::encoder_memory(const stream_t* stream)
+{
+  return lzma_memusage(stream);
+}
+
 
 #if defined(ENABLE_ZLIB)
 const std::string ZIP_INFO::name = "zlib";
@@ -70,14 +101,28 @@ void ZIP_INFO::init_stream_decoder(stream_t* stream, char* raw_data)
 }
 
 void ZIP_INFO::init_stream_encoder(stream_t* stream, char* raw_data)
+{
+  init_stream_encoder(stream, raw_data, zim::CompressionOptions());
+}
+
+void ZIP_INFO::init_stream_encoder(stream_t* stream, char* raw_data, const zim::CompressionOptions& options)
 {
   memset(stream, 0, sizeof(z_stream));
-  auto errcode = ::deflateInit(stream, Z_DEFAULT_COMPRESSION);
+  auto level = options.level < 0 ? Z_DEFAULT_COMPRESSION : std::min(options.level, 9);
+  int windowBits = options.windowLog
+                 ? std::max(9, std::min(int(options.windowLog), MAX_WBITS))
+                 : MAX_WBITS;
+  auto errcode = ::deflateInit2(stream, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
   if (errcode != Z_OK) {
     throw std::runtime_error("Impossible to allocated needed memory to uncompress zlib stream");
   }
 }
 
+int ZIP_INFO::default_level()
+{
+  return 6;
+}
+
 CompStatus ZIP_INFO::stream_run_decode(stream_t* stream, CompStep step) {
   auto errcode = ::inflate(stream, step==CompStep::STEP?Z_SYNC_FLUSH:Z_FINISH);
   if (errcode == Z_BUF_ERROR)
@@ -109,6 +154,12 @@ void ZIP_INFO::stream_end_encode(stream_t* stream) {
   auto ret = ::deflateEnd(stream);
   ASSERT(ret, ==, Z_OK);
 }
+
+size_t ZIP_INFO::encoder_memory(const stream_t* stream) {
+  // zlib does not tell it, this is its documented formula for the largest
+  // window and the memory level used by init_stream_encoder.
+  return (1 << (MAX_WBITS+2)) + (1 << (8+9));
+}
 #endif // ENABLE_ZLIB
 
 const std::string ZSTD_INFO::name = "zstd";
@@ -134,7 +185,8 @@ ZSTD_INFO::stream_t::~stream_t()
 
 void ZSTD_INFO::init_stream_decoder(stream_t* stream, char* raw_data)
 {
-  stream->decoder_stream = ::ZSTD_createDStream();
+  if (!stream->decoder_stream)
+    stream->decoder_stream = ::ZSTD_createDStream();
   auto ret = ::ZSTD_initDStream(stream->decoder_stream);
   if (::ZSTD_isError(ret)) {
     throw std::runtime_error("Failed to initialize Zstd decompression");
@@ -143,13 +195,132 @@ void ZSTD_INFO::init_stream_decoder(stream_t* stream, char* raw_data)
 
 void ZSTD_INFO::init_stream_encoder(stream_t* stream, char* raw_data)
 {
-  stream->encoder_stream = ::ZSTD_createCStream();
+  if (!stream->encoder_stream)
+    stream->encoder_stream = ::ZSTD_createCStream();
   auto ret = ::ZSTD_initCStream(stream->encoder_stream, ::ZSTD_maxCLevel());
   if (::ZSTD_isError(ret)) {
     throw std::runtime_error("Failed to initialize Zstd compression");
   }
 }
 
+namespace
+{
+
+size_t set_zstd_parameters(::ZSTD_CCtx* cctx, const zim::CompressionOptions& options)
+{
+  auto ret = ::ZSTD_CCtx_reset(cctx, ::ZSTD_reset_session_and_parameters);
+  if (!::ZSTD_isError(ret)) {
+    auto level = options.level < 0 ? ZSTD_INFO::default_level() : options.level;
+    ret = ::ZSTD_CCtx_setParameter(cctx, ::ZSTD_c_compressionLevel, level);
+  }
+  if (!::ZSTD_isError(ret) && options.windowLog) {
+    ret = ::ZSTD_CCtx_setParameter(cctx, ::ZSTD_c_windowLog, options.windowLog);
+  }
+  if (!::ZSTD_isError(ret) && options.longDistanceMatching) {
+    ret = ::ZSTD_CCtx_setParameter(cctx, ::ZSTD_c_enableLongDistanceMatching, 1);
+  }
+  if (!::ZSTD_isError(ret) && options.nbWorkers) {
+    // Fails if zstd is built without multithreading support, compress in
+    // the calling thread then.
+    ::ZSTD_CCtx_setParameter(cctx, ::ZSTD_c_nbWorkers, options.nbWorkers);
+  }
+  return ret;
+}
+
+} // namespace
+
+void ZSTD_INFO::init_stream_encoder(stream_t* stream, char* raw_data, const zim::CompressionOptions& options)
+{
+  if (!stream->encoder_stream)
+    stream->encoder_stream = ::ZSTD_createCStream();
+  auto ret = set_zstd_parameters(stream->encoder_stream, options);
+  if (::ZSTD_isError(ret)) {
+    throw std::runtime_error("Failed to initialize Zstd compression");
+  }
+}
+
+void ZSTD_INFO::init_stream_encoder(stream_t* stream, char* raw_data, const ::ZSTD_CDict* dict, const zim::CompressionOptions& options)
+{
+  if (!stream->encoder_stream)
+    stream->encoder_stream = ::ZSTD_createCStream();
+  auto ret = set_zstd_parameters(stream->encoder_stream, options);
+  if (!::ZSTD_isError(ret)) {
+    ret = ::ZSTD_CCtx_refCDict(stream->encoder_stream, dict);
+  }
+  if (::ZSTD_isError(ret)) {
+    throw std::runtime_error("Failed to initialize Zstd compression with dictionary");
+  }
+}
+
+int ZSTD_INFO::default_level()
+{
+  return ::ZSTD_maxCLevel();
+}
+
+void ZSTD_INFO::init_stream_decoder(stream_t* stream, char* raw_data, const ::ZSTD_DDict* dict)
+{
+  if (!stream->decoder_stream)
+    stream->decoder_stream = ::ZSTD_createDStream();
+  auto ret = ::ZSTD_DCtx_reset(stream->decoder_stream, ::ZSTD_reset_session_only);
+  if (!::ZSTD_isError(ret)) {
+    ret = ::ZSTD_DCtx_refDDict(stream->decoder_stream, dict);
+  }
+  if (::ZSTD_isError(ret)) {
+    throw std::runtime_error("Failed to initialize Zstd decompression with dictionary");
+  }
+}
+
+void ZSTD_INFO::init_stream_encoder(stream_t* stream, char* raw_data, const ::ZSTD_CDict* dict)
+{
+  if (!stream->encoder_stream)
+    stream->encoder_stream = ::ZSTD_createCStream();
+  auto ret = ::ZSTD_CCtx_reset(stream->encoder_stream, ::ZSTD_reset_session_only);
+  if (!::ZSTD_isError(ret)) {
+    ret = ::ZSTD_CCtx_refCDict(stream->encoder_stream, dict);
+  }
+  if (::ZSTD_isError(ret)) {
+    throw std::runtime_error("Failed to initialize Zstd compression with dictionary");
+  }
+}
+
+std::shared_ptr<const ::ZSTD_DDict> ZSTD_INFO::create_ddict(const char* data, size_t size)
+{
+  auto dict = ::ZSTD_createDDict(data, size);
+  if (!dict) {
+    throw std::runtime_error("Failed to load Zstd dictionary");
+  }
+  return std::shared_ptr<const ::ZSTD_DDict>(dict, [](const ::ZSTD_DDict* d) {
+    ::ZSTD_freeDDict(const_cast<::ZSTD_DDict*>(d));
+  });
+}
+
+std::shared_ptr<const ::ZSTD_CDict> ZSTD_INFO::create_cdict(const char* data, size_t size, int level)
+{
+  auto dict = ::ZSTD_createCDict(data, size, level < 0 ? default_level() : level);
+  if (!dict) {
+    throw std::runtime_error("Failed to load Zstd dictionary");
+  }
+  return std::shared_ptr<const ::ZSTD_CDict>(dict, [](const ::ZSTD_CDict* d) {
+    ::ZSTD_freeCDict(const_cast<::ZSTD_CDict*>(d));
+  });
+}
+
+std::string ZSTD_INFO::train_dictionary(const std::string& samples,
+                                        const std::vector<size_t>& sampleSizes,
+                                        size_t maxSize)
+{
+  std::string dict(maxSize, '\0');
+  auto ret = ::ZDICT_trainFromBuffer(&dict[0], dict.size(),
+                                     samples.data(),
+                                     sampleSizes.data(),
+                                     sampleSizes.size());
+  if (::ZDICT_isError(ret)) {
+    return std::string();
+  }
+  dict.resize(ret);
+  return dict;
+}
+
 CompStatus ZSTD_INFO::stream_run_encode(stream_t* stream, CompStep step) {
   ::ZSTD_inBuffer inBuf;
   inBuf.src = stream->next_in;
@@ -220,3 +391,8 @@ void ZSTD_INFO::stream_end_decode(stream_t* stream)
 void ZSTD_INFO::stream_end_encode(stream_t* stream)
 {
 }
+
+size_t ZSTD_INFO::encoder_memory(const stream_t* stream)
+{
+  return stream->encoder_stream ? ::ZSTD_sizeof_CStream(stream->encoder_stream) : 0;
+}
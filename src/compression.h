@@ -2,10 +2,13 @@
 #define _LIBZIM_COMPRESSION_
 
 #include <vector>
+#include <memory>
+#include <utility>
 #include "string.h"
 
 #include "file_reader.h"
 #include <zim/error.h>
+#include <zim/zim.h>
 
 #include "config.h"
 
@@ -43,11 +46,14 @@ struct LZMA_INFO {
   static const std::string name;
   static void init_stream_decoder(stream_t* stream, char* raw_data);
   static void init_stream_encoder(stream_t* stream, char* raw_data);
+  static void init_stream_encoder(stream_t* stream, char* raw_data, const zim::CompressionOptions& options);
+  static int default_level();
   static CompStatus stream_run_encode(stream_t* stream, CompStep step);
   static CompStatus stream_run_decode(stream_t* stream, CompStep step);
   static CompStatus stream_run(stream_t* stream, CompStep step);
   static void stream_end_encode(stream_t* stream);
   static void stream_end_decode(stream_t* stream);
+  static size_t encoder_memory(const stream_t* stream);
 };
 
 
@@ -57,10 +63,13 @@ struct ZIP_INFO {
   static const std::string name;
   static void init_stream_decoder(stream_t* stream, char* raw_data);
   static void init_stream_encoder(stream_t* stream, char* raw_data);
+  static void init_stream_encoder(stream_t* stream, char* raw_data, const zim::CompressionOptions& options);
+  static int default_level();
   static CompStatus stream_run_encode(stream_t* stream, CompStep step);
   static CompStatus stream_run_decode(stream_t* stream, CompStep step);
   static void stream_end_encode(stream_t* stream);
   static void stream_end_decode(stream_t* stream);
+  static size_t encoder_memory(const stream_t* stream);
 };
 #endif
 
@@ -86,10 +95,27 @@ struct ZSTD_INFO {
   static const std::string name;
   static void init_stream_decoder(stream_t* stream, char* raw_data);
   static void init_stream_encoder(stream_t* stream, char* raw_data);
+  static void init_stream_decoder(stream_t* stream, char* raw_data, const ::ZSTD_DDict* dict);
+  static void init_stream_encoder(stream_t* stream, char* raw_data, const ::ZSTD_CDict* dict);
+  static void init_stream_encoder(stream_t* stream, char* raw_data, const zim::CompressionOptions& options);
+  static void init_stream_encoder(stream_t* stream, char* raw_data, const ::ZSTD_CDict* dict, const zim::CompressionOptions& options);
+  static int default_level();
   static CompStatus stream_run_encode(stream_t* stream, CompStep step);
   static CompStatus stream_run_decode(stream_t* stream, CompStep step);
   static void stream_end_encode(stream_t* stream);
   static void stream_end_decode(stream_t* stream);
+  static size_t encoder_memory(const stream_t* stream);
+
+  // Dictionaries are digested once and shared by all the streams using them.
+  static std::shared_ptr<const ::ZSTD_DDict> create_ddict(const char* data, size_t size);
+  // A negative level uses the default level.
+  static std::shared_ptr<const ::ZSTD_CDict> create_cdict(const char* data, size_t size, int level = -1);
+
+  // Train a dictionary of at most maxSize bytes from the concatenated samples.
+  // Return an empty string if no dictionary can be trained from the samples.
+  static std::string train_dictionary(const std::string& samples,
+                                      const std::vector<size_t>& sampleSizes,
+                                      size_t maxSize);
 };
 
 
@@ -105,8 +131,9 @@ class Uncompressor
     {}
     ~Uncompressor() = default;
 
-    void init(char* data) {
-      INFO::init_stream_decoder(&stream, data);
+    template<typename... Args>
+    void init(char* data, Args&&... args) {
+      INFO::init_stream_decoder(&stream, data, std::forward<Args>(args)...);
       stream.next_out = (uint8_t*)ret_data.get();
       stream.avail_out = data_size;
     }
@@ -153,8 +180,36 @@ class Uncompressor
       return errcode==CompStatus::STREAM_END?RunnerStatus::OK:RunnerStatus::NEED_MORE;
     }
 
+    /* Start a new compression stream just after the current (ended) one.
+     * The uncompressed data of the new stream is appended to the data already
+     * uncompressed and the remaining input is fed to the new stream.
+     */
+    template<typename... Args>
+    RunnerStatus next_stream(Args&&... args) {
+      auto next_in = stream.next_in;
+      auto avail_in = stream.avail_in;
+      auto next_out = stream.next_out;
+      auto avail_out = stream.avail_out;
+      auto total_out = stream.total_out;
+      INFO::stream_end_decode(&stream);
+      INFO::init_stream_decoder(&stream, (char*)next_in, std::forward<Args>(args)...);
+      stream.next_out = next_out;
+      stream.avail_out = avail_out;
+      stream.total_out = total_out;
+      return feed((char*)next_in, avail_in);
+    }
+
     std::unique_ptr<char[]> get_data(zim::zsize_t* size) {
       feed(nullptr, 0, CompStep::FINISH);
+      return release_data(size);
+    }
+
+    // The data uncompressed so far.
+    const char* data() const { return ret_data.get(); }
+    size_type size() const { return stream.total_out; }
+
+    // Stop the stream where it is, without uncompressing the rest.
+    std::unique_ptr<char[]> release_data(zim::zsize_t* size) {
       size->v = stream.total_out;
       INFO::stream_end_decode(&stream);
       return std::move(ret_data);
@@ -173,10 +228,13 @@ class Uncompressor
  * @param reader         The reader where the data is.
  * @param startOffset    The offset where the data is in the reader.
  * @param dest_size[out] The size of the uncompressed data.
+ * @param nbStreams      The number of compression streams following each
+ *                       other at startOffset.
+ * @param args           Extra arguments passed to the decoder initialization.
  * @return A pointer to the uncompressed data. This must be deleted (delete[])
 */
-template<typename INFO>
-std::unique_ptr<char[]> uncompress(const zim::Reader* reader, zim::offset_t startOffset, zim::zsize_t* dest_size) {
+template<typename INFO, typename... Args>
+std::unique_ptr<char[]> uncompress(const zim::Reader* reader, zim::offset_t startOffset, zim::zsize_t* dest_size, unsigned nbStreams=1, Args&&... args) {
   // Use a compressor to compress the data.
   // As we don't know the result size, neither the compressed size,
   // we have to do chunk by chunk until decompressor is happy.
@@ -187,11 +245,11 @@ std::unique_ptr<char[]> uncompress(const zim::Reader* reader, zim::offset_t star
   std::vector<char> raw_data(CHUNCK_SIZE);
 
   DEB("Init")
-  runner.init(raw_data.data());
+  runner.init(raw_data.data(), args...);
 
   zim::size_type availableSize = reader->size().v - startOffset.v;
   auto ret = RunnerStatus::NEED_MORE;
-  while(ret != RunnerStatus::OK) {
+  while(true) {
     if (ret == RunnerStatus::NEED_MORE and availableSize) {
       zim::size_type inputSize = std::min(availableSize, CHUNCK_SIZE);
       reader->read(raw_data.data(), startOffset, zim::zsize_t(inputSize));
@@ -205,12 +263,56 @@ std::unique_ptr<char[]> uncompress(const zim::Reader* reader, zim::offset_t star
       throw zim::ZimFileFormatError(std::string("Invalid ") + INFO::name
                                + std::string(" stream for cluster."));
     }
+    if (ret == RunnerStatus::OK) {
+      if (--nbStreams == 0)
+        break;
+      ret = runner.next_stream(args...);
+    }
   }
 
   DEB("Finish")
   return runner.get_data(dest_size);
 }
 
+/**
+ * Uncompress only the beginning of the data of the reader at startOffset.
+ *
+ * The input is fed chunk by chunk and the stream is left unfinished as soon
+ * as enough data is uncompressed.
+ *
+ * @param neededSize     Called with the data uncompressed so far and its size,
+ *                       returns the size of uncompressed data needed.
+ * @param dest_size[out] The size of the uncompressed data (at least the
+ *                       needed size).
+ */
+template<typename INFO, typename NeededSize, typename... Args>
+std::unique_ptr<char[]> uncompress_prefix(const zim::Reader* reader, zim::offset_t startOffset, NeededSize neededSize, zim::zsize_t* dest_size, Args&&... args) {
+  Uncompressor<INFO> runner(64*1024);
+  std::vector<char> raw_data(CHUNCK_SIZE);
+  runner.init(raw_data.data(), args...);
+
+  zim::size_type availableSize = reader->size().v - startOffset.v;
+  auto ret = RunnerStatus::NEED_MORE;
+  while (ret == RunnerStatus::NEED_MORE
+      && availableSize
+      && runner.size() < neededSize(runner.data(), runner.size())) {
+    zim::size_type inputSize = std::min(availableSize, CHUNCK_SIZE);
+    reader->read(raw_data.data(), startOffset, zim::zsize_t(inputSize));
+    startOffset.v += inputSize;
+    availableSize -= inputSize;
+    ret = runner.feed(raw_data.data(), inputSize);
+    if (ret == RunnerStatus::ERROR) {
+      throw zim::ZimFileFormatError(std::string("Invalid ") + INFO::name
+                               + std::string(" stream for cluster."));
+    }
+  }
+  if (runner.size() < neededSize(runner.data(), runner.size())) {
+    throw zim::ZimFileFormatError(std::string("Truncated ") + INFO::name
+                             + std::string(" stream for cluster."));
+  }
+  return runner.release_data(dest_size);
+}
+
 template<typename INFO>
 class Compressor
 {
@@ -222,8 +324,9 @@ class Compressor
 
     ~Compressor() = default;
 
-    void init(char* data) {
-      INFO::init_stream_encoder(&stream, data);
+    template<typename... Args>
+    void init(char* data, Args&&... args) {
+      INFO::init_stream_encoder(&stream, data, std::forward<Args>(args)...);
       stream.next_out = (uint8_t*)ret_data.get();
       stream.avail_out = ret_size;
     }
@@ -260,6 +363,11 @@ class Compressor
       return RunnerStatus::NEED_MORE;
     }
 
+    // The memory held by the encoder and the data compressed so far.
+    size_t memory_size() const {
+      return ret_size + INFO::encoder_memory(&stream);
+    }
+
     std::unique_ptr<char[]> get_data(zim::zsize_t* size) {
       feed(nullptr, 0, CompStep::FINISH);
       INFO::stream_end_encode(&stream);
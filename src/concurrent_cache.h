@@ -73,9 +73,52 @@ public: // types
     return x.value().get();
   }
 
+  // The keys in the cache (including the ones being loaded), the most
+  // recently used first.
+  std::vector<Key> getKeys() const
+  {
+    pthread_mutex_lock(&lock_);
+    const auto keys = impl_.keys();
+    pthread_mutex_unlock(&lock_);
+    return keys;
+  }
+
+  size_t getMaxSize() const
+  {
+    pthread_mutex_lock(&lock_);
+    const auto maxSize = impl_.getMaxSize();
+    pthread_mutex_unlock(&lock_);
+    return maxSize;
+  }
+
+  // The entries being loaded may be evicted: the threads waiting for them
+  // still get them.
+  void setMaxSize(size_t maxSize)
+  {
+    pthread_mutex_lock(&lock_);
+    impl_.setMaxSize(maxSize);
+    pthread_mutex_unlock(&lock_);
+  }
+
+  size_t getHits() const
+  {
+    pthread_mutex_lock(&lock_);
+    const auto hits = impl_.getHits();
+    pthread_mutex_unlock(&lock_);
+    return hits;
+  }
+
+  size_t getMisses() const
+  {
+    pthread_mutex_lock(&lock_);
+    const auto misses = impl_.getMisses();
+    pthread_mutex_unlock(&lock_);
+    return misses;
+  }
+
 private: // data
   Impl impl_;
-  pthread_mutex_t lock_;
+  mutable pthread_mutex_t lock_;
 };
 
 } // namespace zim
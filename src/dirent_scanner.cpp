@@ -0,0 +1,175 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include <zim/dirent_scanner.h>
+#include <zim/file.h>
+#include <zim/error.h>
+#include "_dirent.h"
+#include "buffer.h"
+#include "endian_tools.h"
+#include "fileimpl.h"
+#include "log.h"
+#include <algorithm>
+
+log_define("zim.direntscanner")
+
+namespace zim
+{
+  DirentScanner::DirentScanner(const File& file,
+                               article_index_type begin,
+                               article_index_type end_,
+                               size_type chunkSize)
+    : impl(file.impl),
+      idx(begin),
+      end(std::min(end_, file.getCountArticles())),
+      chunkSize(std::max<size_type>(chunkSize, 256)),
+      started(false),
+      urlPtrsBegin(begin),
+      direntsOffset(0),
+      dirent(new Dirent())
+  { }
+
+  DirentScanner::~DirentScanner() = default;
+
+  void DirentScanner::readUrlPtrs()
+  {
+    auto count = std::min<size_type>(end - idx, chunkSize / sizeof(offset_type));
+    offset_type pos = impl->getFileheader().getUrlPtrPos() + offset_type(idx) * sizeof(offset_type);
+    urlPtrs = impl->getRawData(offset_t(pos), zsize_t(count * sizeof(offset_type)));
+    urlPtrsBegin = idx;
+  }
+
+  void DirentScanner::readDirents(offset_type offset, size_type size)
+  {
+    auto fileSize = impl->getFilesize().v;
+    if (offset >= fileSize)
+      throw ZimFileFormatError("Directory entry out of the zim file");
+    size = std::min<offset_type>(size, fileSize - offset);
+    log_debug("read dirents at " << offset << ", size " << size);
+    dirents = impl->getRawData(offset_t(offset), zsize_t(size));
+    direntsOffset = offset;
+  }
+
+  bool DirentScanner::next()
+  {
+    if (started && idx < end)
+      ++idx;
+    started = true;
+    if (idx >= end)
+      return false;
+
+    if (idx - urlPtrsBegin >= urlPtrs.size() / sizeof(offset_type))
+      readUrlPtrs();
+    auto offset = fromLittleEndian<offset_type>(
+      urlPtrs.data() + (idx - urlPtrsBegin) * sizeof(offset_type));
+
+    // The directory entries are usually stored in url order, one after the
+    // other: the chunk read for the previous ones usually has this one.
+    if (offset < direntsOffset || offset >= direntsOffset + dirents.size())
+      readDirents(offset, chunkSize);
+    while (true) {
+      auto start = offset - direntsOffset;
+      auto available = dirents.size() - start;
+      bool atFileEnd = direntsOffset + dirents.size() >= impl->getFilesize().v;
+      // The fixed size part of a dirent is at most 16 bytes.
+      if (available >= 16 || atFileEnd) {
+        const MemoryViewBuffer buffer(dirents.data() + start, zsize_t(available));
+        try {
+          *dirent = Dirent(buffer);
+          return true;
+        } catch (InvalidSize&) {
+          if (atFileEnd)
+            throw ZimFileFormatError("Truncated directory entry");
+        }
+      }
+      // The dirent is cut at the end of the chunk: read again from it, twice
+      // as much if it was already at the start of the chunk.
+      readDirents(offset, start ? chunkSize : 2 * dirents.size());
+    }
+  }
+
+  char DirentScanner::getNamespace() const
+  {
+    return dirent->getNamespace();
+  }
+
+  const std::string& DirentScanner::getUrl() const
+  {
+    return dirent->getUrl();
+  }
+
+  const std::string& DirentScanner::getTitle() const
+  {
+    return dirent->getTitle();
+  }
+
+  std::string DirentScanner::getLongUrl() const
+  {
+    return dirent->getLongUrl();
+  }
+
+  const std::string& DirentScanner::getParameter() const
+  {
+    return dirent->getParameter();
+  }
+
+  uint16_t DirentScanner::getLibraryMimeType() const
+  {
+    return dirent->getMimeType();
+  }
+
+  const std::string& DirentScanner::getMimeType() const
+  {
+    return impl->getMimeType(getLibraryMimeType());
+  }
+
+  bool DirentScanner::isRedirect() const
+  {
+    return dirent->isRedirect();
+  }
+
+  bool DirentScanner::isLinktarget() const
+  {
+    return dirent->isLinktarget();
+  }
+
+  bool DirentScanner::isDeleted() const
+  {
+    return dirent->isDeleted();
+  }
+
+  bool DirentScanner::isArticle() const
+  {
+    return dirent->isArticle();
+  }
+
+  article_index_type DirentScanner::getRedirectIndex() const
+  {
+    return dirent->getRedirectIndex().v;
+  }
+
+  cluster_index_type DirentScanner::getClusterNumber() const
+  {
+    return dirent->getClusterNumber().v;
+  }
+
+  blob_index_type DirentScanner::getBlobNumber() const
+  {
+    return dirent->getBlobNumber().v;
+  }
+
+}
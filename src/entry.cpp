@@ -0,0 +1,156 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include <zim/entry.h>
+#include "_dirent.h"
+#include "cluster.h"
+#include "fileimpl.h"
+#include <limits>
+
+namespace zim
+{
+  Entry::Entry()
+    : idx(std::numeric_limits<article_index_type>::max())
+  { }
+
+  Entry::Entry(std::shared_ptr<FileImpl> file_, article_index_type idx_)
+    : file(file_),
+      idx(idx_),
+      dirent(file->getDirent(article_index_t(idx)))
+  { }
+
+  const std::string& Entry::getParameter() const
+  {
+    return dirent->getParameter();
+  }
+
+  const std::string& Entry::getTitle() const
+  {
+    return dirent->getTitle();
+  }
+
+  const std::string& Entry::getUrl() const
+  {
+    return dirent->getUrl();
+  }
+
+  std::string Entry::getLongUrl() const
+  {
+    return dirent->getLongUrl();
+  }
+
+  uint16_t Entry::getLibraryMimeType() const
+  {
+    return dirent->getMimeType();
+  }
+
+  const std::string& Entry::getMimeType() const
+  {
+    return file->getMimeType(getLibraryMimeType());
+  }
+
+  bool Entry::isRedirect() const
+  {
+    return dirent->isRedirect();
+  }
+
+  bool Entry::isLinktarget() const
+  {
+    return dirent->isLinktarget();
+  }
+
+  bool Entry::isDeleted() const
+  {
+    return dirent->isDeleted();
+  }
+
+  char Entry::getNamespace() const
+  {
+    return dirent->getNamespace();
+  }
+
+  article_index_type Entry::getRedirectIndex() const
+  {
+    return article_index_type(dirent->getRedirectIndex());
+  }
+
+  Entry Entry::getRedirectEntry() const
+  {
+    return Entry(file, getRedirectIndex());
+  }
+
+  size_type Entry::getArticleSize() const
+  {
+    if (cluster) {
+      return size_type(cluster->getBlobSize(dirent->getBlobNumber()));
+    }
+    return size_type(file->getBlobSize(dirent->getClusterNumber(),
+                                       dirent->getBlobNumber()));
+  }
+
+  Entry& Entry::pinCluster()
+  {
+    if (!cluster) {
+      cluster = getCluster();
+    }
+    return *this;
+  }
+
+  std::shared_ptr<const Cluster> Entry::getCluster() const
+  {
+    if (cluster || !dirent->isArticle()) {
+      return cluster;
+    }
+    return file->getCluster(dirent->getClusterNumber());
+  }
+
+  cluster_index_type Entry::getClusterNumber() const
+  {
+    if ( !dirent->isArticle() ) {
+      return std::numeric_limits<cluster_index_type>::max();
+    }
+    return dirent->getClusterNumber().v;
+  }
+
+  blob_index_type Entry::getBlobNumber() const
+  {
+    if ( !dirent->isArticle() ) {
+      return std::numeric_limits<blob_index_type>::max();
+    }
+    return dirent->getBlobNumber().v;
+  }
+
+  Blob Entry::getData(offset_type offset) const
+  {
+    auto dataCluster = getCluster();
+    if (!dataCluster) {
+      return Blob();
+    }
+    auto blobNumber = dirent->getBlobNumber();
+    return dataCluster->getBlob(blobNumber, offset_t(offset), dataCluster->getBlobSize(blobNumber));
+  }
+
+  Blob Entry::getData(offset_type offset, size_type size) const
+  {
+    auto dataCluster = getCluster();
+    if (!dataCluster) {
+      return Blob();
+    }
+    return dataCluster->getBlob(dirent->getBlobNumber(), offset_t(offset), zsize_t(size));
+  }
+
+}
@@ -23,7 +23,13 @@
 #include <zim/search.h>
 #include "log.h"
 #include <zim/fileiterator.h>
+#include <zim/dirent_scanner.h>
 #include <zim/error.h>
+#include "cluster.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <pthread.h>
 
 log_define("zim.file")
 
@@ -41,6 +47,122 @@ namespace zim
         return ch - 'A' + 10;
       return -1;
     }
+
+    // An article of the parallelForEach iteration.
+    struct ForEachEntry
+    {
+      cluster_index_type cluster;
+      blob_index_type blob;
+      article_index_type article;
+
+      bool operator<(const ForEachEntry& other) const
+      {
+        return cluster < other.cluster
+            || (cluster == other.cluster && blob < other.blob);
+      }
+    };
+
+    // The clusters (as indexes in groupStarts) a worker has still to do.
+    struct ForEachRange
+    {
+      size_t begin = 0;
+      size_t end = 0;
+      pthread_mutex_t lock;
+
+      ForEachRange() { pthread_mutex_init(&lock, NULL); }
+      ~ForEachRange() { pthread_mutex_destroy(&lock); }
+    };
+
+    struct ForEachJob
+    {
+      std::shared_ptr<FileImpl> impl;
+      File::ForEachCallback callback;
+      std::vector<ForEachEntry> entries;
+      // The first entry of each cluster, and the end of the entries.
+      std::vector<size_t> groupStarts;
+      std::vector<ForEachRange> ranges;
+
+      std::atomic<bool> stop;
+      std::exception_ptr error;
+      pthread_mutex_t errorLock;
+
+      ForEachJob() : stop(false) { pthread_mutex_init(&errorLock, NULL); }
+      ~ForEachJob() { pthread_mutex_destroy(&errorLock); }
+    };
+
+    struct ForEachWorker
+    {
+      ForEachJob* job;
+      size_t id;
+    };
+
+    // Take the next cluster of the worker's range, or steal the second half
+    // of the range of another worker if there is none left.
+    bool nextGroup(ForEachJob* job, size_t id, size_t* group)
+    {
+      auto& own = job->ranges[id];
+      pthread_mutex_lock(&own.lock);
+      if (own.begin < own.end) {
+        *group = own.begin++;
+        pthread_mutex_unlock(&own.lock);
+        return true;
+      }
+      pthread_mutex_unlock(&own.lock);
+
+      for (size_t i = 1; i < job->ranges.size(); ++i) {
+        auto& victim = job->ranges[(id + i) % job->ranges.size()];
+        pthread_mutex_lock(&victim.lock);
+        if (victim.begin >= victim.end) {
+          pthread_mutex_unlock(&victim.lock);
+          continue;
+        }
+        auto middle = victim.begin + (victim.end - victim.begin) / 2;
+        auto stolenEnd = victim.end;
+        victim.end = middle;
+        if (middle == victim.begin) {
+          // Only one cluster left, take it.
+          victim.end = stolenEnd;
+          *group = victim.begin++;
+          pthread_mutex_unlock(&victim.lock);
+          return true;
+        }
+        pthread_mutex_unlock(&victim.lock);
+
+        pthread_mutex_lock(&own.lock);
+        own.begin = middle + 1;
+        own.end = stolenEnd;
+        pthread_mutex_unlock(&own.lock);
+        *group = middle;
+        return true;
+      }
+      return false;
+    }
+
+    void* forEachWorker(void* arg)
+    {
+      auto worker = static_cast<ForEachWorker*>(arg);
+      auto job = worker->job;
+      size_t group;
+      while (!job->stop && nextGroup(job, worker->id, &group)) {
+        try {
+          auto begin = job->groupStarts[group];
+          auto end = job->groupStarts[group+1];
+          auto cluster = job->impl->readCluster(cluster_index_t(job->entries[begin].cluster));
+          for (auto i = begin; i < end && !job->stop; ++i) {
+            auto& entry = job->entries[i];
+            job->callback(Article(job->impl, entry.article),
+                          cluster->getBlob(blob_index_t(entry.blob)));
+          }
+        } catch (...) {
+          pthread_mutex_lock(&job->errorLock);
+          if (!job->error)
+            job->error = std::current_exception();
+          pthread_mutex_unlock(&job->errorLock);
+          job->stop = true;
+        }
+      }
+      return nullptr;
+    }
   }
 
   File::File(const std::string& fname)
@@ -88,6 +210,18 @@ namespace zim
     return r.first ? Article(impl, article_index_type(r.second)) : Article();
   }
 
+  std::vector<Article> File::findBatch(const std::vector<std::string>& urls) const
+  {
+    log_trace("File::findBatch(" << urls.size() << " urls)");
+    auto r = impl->findxBatch(urls);
+    std::vector<Article> articles;
+    articles.reserve(r.size());
+    for (auto& found: r) {
+      articles.push_back(found.first ? Article(impl, article_index_type(found.second)) : Article());
+    }
+    return articles;
+  }
+
   Article File::getArticleByTitle(article_index_type idx) const
   {
     return Article(impl, article_index_type(impl->getIndexByTitle(article_index_t(idx))));
@@ -127,6 +261,11 @@ namespace zim
     return offset_type(impl->getClusterOffset(cluster_index_t(idx)));
   }
 
+  Blob File::getRawCluster(cluster_index_type idx) const
+  {
+    return impl->getRawCluster(cluster_index_t(idx));
+  }
+
   Blob File::getBlob(cluster_index_type clusterIdx, blob_index_type blobIdx) const
   {
     return impl->getCluster(cluster_index_t(clusterIdx))->getBlob(blob_index_t(blobIdx));
@@ -147,6 +286,60 @@ namespace zim
     return getNamespaceEndOffset(ns) - getNamespaceBeginOffset(ns);
   }
 
+  void File::parallelForEach(ForEachCallback callback, unsigned nbThreads) const
+  {
+    ForEachJob job;
+    job.impl = impl;
+    job.callback = callback;
+
+    // The articles, grouped by cluster.
+    DirentScanner scanner(*this);
+    while (scanner.next()) {
+      if (!scanner.isArticle())
+        continue;
+      if (scanner.getClusterNumber() >= getCountClusters())
+        throw ZimFileFormatError("cluster index out of range");
+      job.entries.push_back(ForEachEntry{scanner.getClusterNumber(),
+                                         scanner.getBlobNumber(),
+                                         scanner.getIndex()});
+    }
+    std::sort(job.entries.begin(), job.entries.end());
+    for (size_t i = 0; i < job.entries.size(); ++i) {
+      if (i == 0 || job.entries[i].cluster != job.entries[i-1].cluster)
+        job.groupStarts.push_back(i);
+    }
+    auto nbGroups = job.groupStarts.size();
+    job.groupStarts.push_back(job.entries.size());
+
+    if (!nbThreads)
+      nbThreads = 1;
+    job.ranges = std::vector<ForEachRange>(nbThreads);
+    for (unsigned i = 0; i < nbThreads; ++i) {
+      job.ranges[i].begin = nbGroups * i / nbThreads;
+      job.ranges[i].end = nbGroups * (i+1) / nbThreads;
+    }
+
+    // The ranges of the workers which could not be started are stolen by
+    // the others.
+    std::vector<ForEachWorker> workers(nbThreads);
+    std::vector<pthread_t> threads;
+    for (unsigned i = 0; i < nbThreads; ++i) {
+      workers[i].job = &job;
+      workers[i].id = i;
+      pthread_t thread;
+      if (pthread_create(&thread, NULL, forEachWorker, &workers[i]) == 0)
+        threads.push_back(thread);
+    }
+    if (threads.empty()) {
+      forEachWorker(&workers[0]);
+    }
+    for (auto& thread: threads) {
+      pthread_join(thread, nullptr);
+    }
+    if (job.error)
+      std::rethrow_exception(job.error);
+  }
+
   std::string File::getNamespaces() const
   {
     return impl->getNamespaces();
@@ -210,6 +403,76 @@ namespace zim
                            blob_index_t(blobIdx)));
   }
 
+  size_type File::getClusterCacheHits() const
+  {
+    return impl->getClusterCacheHits();
+  }
+
+  size_type File::getClusterCacheMisses() const
+  {
+    return impl->getClusterCacheMisses();
+  }
+
+  size_type File::getCompressedClusterCacheHits() const
+  {
+    return impl->getCompressedClusterCacheHits();
+  }
+
+  size_type File::getCompressedClusterCacheMisses() const
+  {
+    return impl->getCompressedClusterCacheMisses();
+  }
+
+  size_type File::getCompressedClusterCacheSize() const
+  {
+    return impl->getCompressedClusterCacheSize();
+  }
+
+  void File::saveCacheState(const std::string& path) const
+  {
+    impl->saveCacheState(path);
+  }
+
+  bool File::loadCacheState(const std::string& path)
+  {
+    return impl->loadCacheState(path);
+  }
+
+  void File::waitCacheState()
+  {
+    impl->waitCacheState();
+  }
+
+  size_type File::getDirentCacheMaxSize() const
+  {
+    return impl->getDirentCacheMaxSize();
+  }
+
+  void File::setDirentCacheMaxSize(size_type nbDirents)
+  {
+    impl->setDirentCacheMaxSize(nbDirents);
+  }
+
+  size_type File::getClusterCacheMaxSize() const
+  {
+    return impl->getClusterCacheMaxSize();
+  }
+
+  void File::setClusterCacheMaxSize(size_type nbClusters)
+  {
+    impl->setClusterCacheMaxSize(nbClusters);
+  }
+
+  size_type File::getCompressedClusterCacheMaxSize() const
+  {
+    return impl->getCompressedClusterCacheMaxSize();
+  }
+
+  void File::setCompressedClusterCacheMaxSize(size_type nbBytes)
+  {
+    impl->setCompressedClusterCacheMaxSize(nbBytes);
+  }
+
   time_t File::getMTime() const
   {
     return impl->getMTime();
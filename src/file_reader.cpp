@@ -158,34 +158,126 @@ bool Reader::can_read(offset_t offset, zsize_t size)
 }
 
 
-std::shared_ptr<const Buffer> Reader::get_clusterBuffer(offset_t offset, CompressionType comp) const
+std::shared_ptr<const Buffer> Reader::get_clusterBuffer(offset_t offset, CompressionType comp, unsigned nbStreams, const ZSTD_DDict* zstdDict) const
 {
   zsize_t uncompressed_size(0);
   std::unique_ptr<char[]> uncompressed_data;
   switch (comp) {
     case zimcompLzma:
-      uncompressed_data = uncompress<LZMA_INFO>(this, offset, &uncompressed_size);
+      uncompressed_data = uncompress<LZMA_INFO>(this, offset, &uncompressed_size, nbStreams);
       break;
     case zimcompZip:
 #if defined(ENABLE_ZLIB)
-      uncompressed_data = uncompress<ZIP_INFO>(this, offset, &uncompressed_size);
+      uncompressed_data = uncompress<ZIP_INFO>(this, offset, &uncompressed_size, nbStreams);
 #else
       throw std::runtime_error("zlib not enabled in this library");
 #endif
       break;
     case zimcompZstd:
-      uncompressed_data = uncompress<ZSTD_INFO>(this, offset, &uncompressed_size);
+      uncompressed_data = uncompress<ZSTD_INFO>(this, offset, &uncompressed_size, nbStreams);
+      break;
+    case zimcompZstdDict:
+      if (!zstdDict) {
+        throw ZimFileFormatError("Missing zstd dictionary to uncompress cluster.");
+      }
+      uncompressed_data = uncompress<ZSTD_INFO>(this, offset, &uncompressed_size, nbStreams, zstdDict);
       break;
     default:
-      throw std::logic_error("compressions should not be something else than zimcompLzma, zimComZip or zimcompZstd.");
+      throw std::logic_error("compressions should not be something else than zimcompLzma, zimComZip, zimcompZstd or zimcompZstdDict.");
   }
   return std::make_shared<MemoryBuffer>(std::move(uncompressed_data), uncompressed_size);
 }
 
-std::unique_ptr<const Reader> Reader::sub_clusterReader(offset_t offset, CompressionType* comp, bool* extended) const {
+namespace {
+
+// The size of the offsets table of a cluster, given its beginning.
+template<typename OFFSET_TYPE>
+zim::size_type offsetsTableSize(const char* data, zim::size_type size)
+{
+  if (size < sizeof(OFFSET_TYPE))
+    return sizeof(OFFSET_TYPE);
+  // The first offset is the offset of the first blob, just after the table.
+  return fromLittleEndian<OFFSET_TYPE>(data);
+}
+
+template<typename OFFSET_TYPE>
+std::vector<offset_type> parseClusterOffsets(const char* data, zim::size_type size)
+{
+  auto tableSize = offsetsTableSize<OFFSET_TYPE>(data, size);
+  if (tableSize < sizeof(OFFSET_TYPE) || tableSize % sizeof(OFFSET_TYPE) || tableSize > size)
+    throw ZimFileFormatError("Invalid cluster offsets");
+  std::vector<offset_type> offsets;
+  offsets.reserve(tableSize / sizeof(OFFSET_TYPE));
+  for (zim::size_type pos = 0; pos < tableSize; pos += sizeof(OFFSET_TYPE)) {
+    offset_type offset = fromLittleEndian<OFFSET_TYPE>(data + pos);
+    if (offset < tableSize || (!offsets.empty() && offset < offsets.back()))
+      throw ZimFileFormatError("Invalid cluster offsets");
+    offsets.push_back(offset);
+  }
+  return offsets;
+}
+
+} // unnamed namespace
+
+std::vector<offset_type> Reader::read_clusterOffsets(offset_t offset, const ZSTD_DDict* zstdDict) const
+{
+  uint8_t clusterInfo = read(offset);
+  auto comp = static_cast<CompressionType>(clusterInfo & 0x0F);
+  bool extended = clusterInfo & 0x10;
+  offset += offset_t(1);
+  auto neededSize = extended ? &offsetsTableSize<uint64_t> : &offsetsTableSize<uint32_t>;
+
+  // The offsets are at the beginning of the (first stream of the) cluster.
+  zsize_t size(0);
+  std::shared_ptr<const Buffer> buffer;
+  std::unique_ptr<char[]> data;
+  switch (comp) {
+    case zimcompDefault:
+    case zimcompNone:
+      {
+        auto header = get_buffer(offset, zsize_t(extended ? sizeof(uint64_t) : sizeof(uint32_t)));
+        size = zsize_t(neededSize(header->data(), header->size().v));
+        if (size.v > this->size().v - offset.v)
+          throw ZimFileFormatError("Invalid cluster offsets");
+        buffer = get_buffer(offset, size);
+      }
+      break;
+    case zimcompLzma:
+      data = uncompress_prefix<LZMA_INFO>(this, offset, neededSize, &size);
+      break;
+    case zimcompZip:
+#if defined(ENABLE_ZLIB)
+      data = uncompress_prefix<ZIP_INFO>(this, offset, neededSize, &size);
+#else
+      throw std::runtime_error("zlib not enabled in this library");
+#endif
+      break;
+    case zimcompZstd:
+      data = uncompress_prefix<ZSTD_INFO>(this, offset, neededSize, &size);
+      break;
+    case zimcompZstdDict:
+      if (!zstdDict) {
+        throw ZimFileFormatError("Missing zstd dictionary to uncompress cluster.");
+      }
+      data = uncompress_prefix<ZSTD_INFO>(this, offset, neededSize, &size, zstdDict);
+      break;
+    case zimcompBzip2:
+      throw std::runtime_error("bzip2 not enabled in this library");
+    default:
+      throw ZimFileFormatError("Invalid compression flag");
+  }
+  const char* begin = data ? data.get() : buffer->data();
+  if (extended)
+    return parseClusterOffsets<uint64_t>(begin, size.v);
+  return parseClusterOffsets<uint32_t>(begin, size.v);
+}
+
+std::unique_ptr<const Reader> Reader::sub_clusterReader(offset_t offset, CompressionType* comp, bool* extended, const ZSTD_DDict* zstdDict) const {
   uint8_t clusterInfo = read(offset);
   *comp = static_cast<CompressionType>(clusterInfo & 0x0F);
   *extended = clusterInfo & 0x10;
+  // Offsets and blobs data may be compressed in two separated streams.
+  unsigned nbStreams = (clusterInfo & 0x20) ? 2 : 1;
 
   switch (*comp) {
     case zimcompDefault:
@@ -199,8 +291,9 @@ std::unique_ptr<const Reader> Reader::sub_clusterReader(offset_t offset, Compres
     case zimcompLzma:
     case zimcompZip:
     case zimcompZstd:
+    case zimcompZstdDict:
       {
-        auto buffer = get_clusterBuffer(offset+offset_t(1), *comp);
+        auto buffer = get_clusterBuffer(offset+offset_t(1), *comp, nbStreams, zstdDict);
         return std::unique_ptr<Reader>(new BufferReader(buffer));
       }
       break;
@@ -21,11 +21,14 @@
 #define ZIM_FILE_READER_H_
 
 #include <memory>
+#include <vector>
 
 #include "zim_types.h"
 #include "endian_tools.h"
 #include "debug.h"
 
+typedef struct ZSTD_DDict_s ZSTD_DDict;
+
 namespace zim {
 
 class Buffer;
@@ -58,14 +61,21 @@ class Reader {
     }
     virtual offset_t offset() const = 0;
 
+    // zstdDict is the dictionary used by zimcompZstdDict clusters.
     std::unique_ptr<const Reader> sub_clusterReader(offset_t offset,
                                                     CompressionType* comp,
-                                                    bool* extented) const;
+                                                    bool* extented,
+                                                    const ZSTD_DDict* zstdDict = nullptr) const;
+
+    // Read the offsets of the blobs of the cluster at offset, uncompressing
+    // only the beginning of the cluster.
+    std::vector<offset_type> read_clusterOffsets(offset_t offset,
+                                                 const ZSTD_DDict* zstdDict = nullptr) const;
 
     bool can_read(offset_t offset, zsize_t size);
 
   private:
-    std::shared_ptr<const Buffer> get_clusterBuffer(offset_t offset, CompressionType comp) const;
+    std::shared_ptr<const Buffer> get_clusterBuffer(offset_t offset, CompressionType comp, unsigned nbStreams, const ZSTD_DDict* zstdDict) const;
 };
 
 class FileReader : public Reader {
@@ -18,7 +18,9 @@
  */
 
 #include "fileimpl.h"
+#include <algorithm>
 #include <zim/error.h>
+#include <zim/blob.h>
 #include "_dirent.h"
 #include "file_compound.h"
 #include "file_reader.h"
@@ -29,13 +31,18 @@
 #include <errno.h>
 #include <cstring>
 #include <fstream>
+#include <limits>
 #include "config.h"
 #include "log.h"
 #include "envvalue.h"
 #include "md5.h"
+#include "compression.h"
 
 log_define("zim.file.impl")
 
+// There is usually one template (the layout page) in a zim file.
+#define TEMPLATE_CACHE_SIZE 16
+
 namespace zim
 {
 
@@ -48,8 +55,65 @@ offset_t readOffset(const Reader& reader, size_t idx)
   return offset;
 }
 
+// The cache sizes set with the setDefault...CacheMaxSize functions, unset
+// (the env variables and build defaults are used) if max.
+const size_type unsetCacheSize = std::numeric_limits<size_type>::max();
+std::atomic<size_type> defaultDirentCacheSize(unsetCacheSize);
+std::atomic<size_type> defaultClusterCacheSize(unsetCacheSize);
+std::atomic<size_type> defaultCompressedClusterCacheSize(unsetCacheSize);
+
+size_type direntCacheSize()
+{
+  auto size = defaultDirentCacheSize.load();
+  return size != unsetCacheSize ? size : envValue("ZIM_DIRENTCACHE", DIRENT_CACHE_SIZE);
+}
+
+size_type clusterCacheSize()
+{
+  auto size = defaultClusterCacheSize.load();
+  return size != unsetCacheSize ? size : envValue("ZIM_CLUSTERCACHE", CLUSTER_CACHE_SIZE);
+}
+
+size_type compressedClusterCacheSize()
+{
+  auto size = defaultCompressedClusterCacheSize.load();
+  return size != unsetCacheSize
+    ? size
+    : envMemSize("ZIM_COMPRESSEDCLUSTERCACHE", COMPRESSED_CLUSTER_CACHE_SIZE * 1024 * 1024);
+}
+
 } //unnamed namespace
 
+  void setDefaultDirentCacheMaxSize(size_type nbDirents)
+  {
+    defaultDirentCacheSize = nbDirents;
+  }
+
+  size_type getDefaultDirentCacheMaxSize()
+  {
+    return direntCacheSize();
+  }
+
+  void setDefaultClusterCacheMaxSize(size_type nbClusters)
+  {
+    defaultClusterCacheSize = nbClusters;
+  }
+
+  size_type getDefaultClusterCacheMaxSize()
+  {
+    return clusterCacheSize();
+  }
+
+  void setDefaultCompressedClusterCacheMaxSize(size_type nbBytes)
+  {
+    defaultCompressedClusterCacheSize = nbBytes;
+  }
+
+  size_type getDefaultCompressedClusterCacheMaxSize()
+  {
+    return compressedClusterCacheSize();
+  }
+
   //////////////////////////////////////////////////////////////////////
   // FileImpl
   //
@@ -59,12 +123,19 @@ offset_t readOffset(const Reader& reader, size_t idx)
       bufferDirentZone(256),
       bufferDirentLock(PTHREAD_MUTEX_INITIALIZER),
       filename(fname),
-      direntCache(envValue("ZIM_DIRENTCACHE", DIRENT_CACHE_SIZE)),
+      direntCache(direntCacheSize()),
       direntCacheLock(PTHREAD_MUTEX_INITIALIZER),
-      clusterCache(envValue("ZIM_CLUSTERCACHE", CLUSTER_CACHE_SIZE)),
+      clusterCache(clusterCacheSize()),
+      compressedClusterCache(compressedClusterCacheSize()),
+      compressedClusterCacheLock(PTHREAD_MUTEX_INITIALIZER),
+      blobOffsetsCache(envValue("ZIM_BLOBOFFSETSCACHE", BLOB_OFFSETS_CACHE_SIZE)),
+      templateCache(TEMPLATE_CACHE_SIZE),
       cacheUncompressedCluster(envValue("ZIM_CACHEUNCOMPRESSEDCLUSTER", false)),
       namespaceBeginLock(PTHREAD_MUTEX_INITIALIZER),
-      namespaceEndLock(PTHREAD_MUTEX_INITIALIZER)
+      namespaceEndLock(PTHREAD_MUTEX_INITIALIZER),
+      preloading(false),
+      preloadLock(PTHREAD_MUTEX_INITIALIZER),
+      stopPreload(false)
   {
     log_trace("read file \"" << fname << '"');
 
@@ -185,6 +256,79 @@ offset_t readOffset(const Reader& reader, size_t idx)
     return findx(url[start], url.substr(2+start));
   }
 
+  std::vector<std::pair<bool, article_index_t>> FileImpl::findxBatch(const std::vector<std::string>& urls)
+  {
+    log_debug("find " << urls.size() << " articles by url, in file \"" << getFilename() << '"');
+
+    std::vector<std::pair<bool, article_index_t>> ret(urls.size(),
+      std::pair<bool, article_index_t>(false, article_index_t(0)));
+
+    // The valid urls, as their index in urls and the offset of their
+    // namespace, sorted by url.
+    std::vector<std::pair<size_t, size_t>> queries;
+    queries.reserve(urls.size());
+    for (size_t i = 0; i < urls.size(); ++i) {
+      auto& url = urls[i];
+      size_t start = (!url.empty() && url[0] == '/') ? 1 : 0;
+      if (url.size() < (2+start) || url[1+start] != '/')
+        continue;
+      queries.push_back(std::make_pair(i, start));
+    }
+    auto compare = [&](char ns, const std::string& url, size_t start,
+                       const Dirent& d) -> int {
+      return ns < d.getNamespace() ? -1
+           : ns > d.getNamespace() ? 1
+           : url.compare(start+2, std::string::npos, d.getUrl());
+    };
+    std::sort(queries.begin(), queries.end(),
+      [&](const std::pair<size_t, size_t>& a, const std::pair<size_t, size_t>& b) {
+        auto& urlA = urls[a.first];
+        auto& urlB = urls[b.first];
+        char nsA = urlA[a.second];
+        char nsB = urlB[b.second];
+        if (nsA != nsB)
+          return nsA < nsB;
+        return urlA.compare(a.second+2, std::string::npos,
+                            urlB, b.second+2, std::string::npos) < 0;
+      });
+
+    // Each query is after the previous one: search from the previous result,
+    // with steps doubling until the query is passed (galloping search).
+    // Close queries share the reads of their dirents.
+    const uint64_t count = getCountArticles().v;
+    uint64_t lower = 0;
+    for (auto& query: queries) {
+      auto& url = urls[query.first];
+      char ns = url[query.second];
+      auto cmp = [&](uint64_t idx) {
+        return compare(ns, url, query.second, *getDirent(article_index_t(idx)));
+      };
+
+      // All dirents before l are before the query, the dirent at u (if any)
+      // is not.
+      uint64_t l = lower;
+      uint64_t u = lower;
+      uint64_t step = 1;
+      while (u < count && cmp(u) > 0) {
+        l = u + 1;
+        u = l + step;
+        step *= 2;
+      }
+      u = std::min(u, count);
+      while (l < u) {
+        uint64_t p = l + (u - l) / 2;
+        if (cmp(p) > 0)
+          l = p + 1;
+        else
+          u = p;
+      }
+      lower = l;
+      if (l < count && cmp(l) == 0)
+        ret[query.first] = std::make_pair(true, article_index_t(article_index_type(l)));
+    }
+    return ret;
+  }
+
   std::pair<bool, article_index_t> FileImpl::findxByTitle(char ns, const std::string& title)
   {
     log_debug("find article by title " << ns << " \"" << title << "\", in file \"" << getFilename() << '"');
@@ -353,22 +497,130 @@ offset_t readOffset(const Reader& reader, size_t idx)
     return ret;
   }
 
-  FileImpl::ClusterHandle FileImpl::readCluster(cluster_index_t idx)
+  FileImpl::ClusterHandle FileImpl::readCluster(cluster_index_t idx, bool useCompressedCache)
   {
     offset_t clusterOffset(getClusterOffset(idx));
     log_debug("read cluster " << idx << " from offset " << clusterOffset);
     CompressionType comp;
     bool extended;
-    std::shared_ptr<const Reader> reader = zimReader->sub_clusterReader(clusterOffset, &comp, &extended);
+    const ZSTD_DDict* dict = nullptr;
+    auto clusterComp = static_cast<CompressionType>(zimReader->read(clusterOffset) & 0x0F);
+    if (clusterComp == zimcompZstdDict) {
+      dict = getZstdDict();
+    }
+    std::shared_ptr<const Reader> reader;
+    if (!useCompressedCache || clusterComp == zimcompDefault || clusterComp == zimcompNone) {
+      // Uncompressed clusters are read from the file as needed.
+      reader = zimReader->sub_clusterReader(clusterOffset, &comp, &extended, dict);
+    } else {
+      // Uncompress the cluster from its (cached) compressed bytes.
+      BufferReader compressedReader(getCompressedCluster(idx));
+      reader = compressedReader.sub_clusterReader(offset_t(0), &comp, &extended, dict);
+    }
     return std::make_shared<Cluster>(reader, comp, extended);
   }
 
+  std::shared_ptr<const Buffer> FileImpl::getCompressedCluster(cluster_index_t idx)
+  {
+    pthread_mutex_lock(&compressedClusterCacheLock);
+    auto v = compressedClusterCache.get(idx);
+    pthread_mutex_unlock(&compressedClusterCacheLock);
+    if (v.hit())
+      return v.value();
+
+    // Copy the bytes: the cache must not depend on the file being mmapped
+    // (and its pages still in memory).
+    auto offset = getClusterOffset(idx);
+    zsize_t size(getClusterEnd(idx).v - offset.v);
+    auto buffer = std::make_shared<MemoryBuffer>(size);
+    zimReader->read(buffer->buf(), offset, size);
+
+    pthread_mutex_lock(&compressedClusterCacheLock);
+    compressedClusterCache.put(idx, buffer, size.v);
+    pthread_mutex_unlock(&compressedClusterCacheLock);
+    return buffer;
+  }
+
+  size_type FileImpl::getDirentCacheMaxSize() const
+  {
+    pthread_mutex_lock(&direntCacheLock);
+    auto size = direntCache.getMaxSize();
+    pthread_mutex_unlock(&direntCacheLock);
+    return size;
+  }
+
+  void FileImpl::setDirentCacheMaxSize(size_type nbDirents)
+  {
+    pthread_mutex_lock(&direntCacheLock);
+    direntCache.setMaxSize(nbDirents);
+    pthread_mutex_unlock(&direntCacheLock);
+  }
+
+  size_type FileImpl::getCompressedClusterCacheMaxSize() const
+  {
+    pthread_mutex_lock(&compressedClusterCacheLock);
+    auto size = compressedClusterCache.getMaxSize();
+    pthread_mutex_unlock(&compressedClusterCacheLock);
+    return size;
+  }
+
+  void FileImpl::setCompressedClusterCacheMaxSize(size_type nbBytes)
+  {
+    pthread_mutex_lock(&compressedClusterCacheLock);
+    compressedClusterCache.setMaxSize(nbBytes);
+    pthread_mutex_unlock(&compressedClusterCacheLock);
+  }
+
+  size_type FileImpl::getCompressedClusterCacheHits() const
+  {
+    pthread_mutex_lock(&compressedClusterCacheLock);
+    auto hits = compressedClusterCache.getHits();
+    pthread_mutex_unlock(&compressedClusterCacheLock);
+    return hits;
+  }
+
+  size_type FileImpl::getCompressedClusterCacheMisses() const
+  {
+    pthread_mutex_lock(&compressedClusterCacheLock);
+    auto misses = compressedClusterCache.getMisses();
+    pthread_mutex_unlock(&compressedClusterCacheLock);
+    return misses;
+  }
+
+  size_type FileImpl::getCompressedClusterCacheSize() const
+  {
+    pthread_mutex_lock(&compressedClusterCacheLock);
+    auto size = compressedClusterCache.cost();
+    pthread_mutex_unlock(&compressedClusterCacheLock);
+    return size;
+  }
+
+  const ZSTD_DDict* FileImpl::getZstdDict()
+  {
+    std::call_once(zstdDictOnceFlag, [this](){
+      auto r = findx('M', "ZstdDictionary");
+      if (!r.first)
+        throw ZimFileFormatError("zstd dictionary not found");
+      auto dirent = getDirent(r.second);
+      if (!dirent->isArticle())
+        throw ZimFileFormatError("invalid zstd dictionary entry");
+      // The dictionary itself cannot be compressed with the dictionary.
+      auto clusterIdx = dirent->getClusterNumber();
+      if (clusterIdx >= getCountClusters()
+       || (zimReader->read(getClusterOffset(clusterIdx)) & 0x0F) == zimcompZstdDict)
+        throw ZimFileFormatError("invalid zstd dictionary entry");
+      auto blob = getCluster(clusterIdx)->getBlob(dirent->getBlobNumber());
+      zstdDict = ZSTD_INFO::create_ddict(blob.data(), blob.size());
+    });
+    return zstdDict.get();
+  }
+
   std::shared_ptr<const Cluster> FileImpl::getCluster(cluster_index_t idx)
   {
     if (idx >= getCountClusters())
       throw ZimFileFormatError("cluster index out of range");
 
-    return clusterCache.getOrPut(idx, [=](){ return readCluster(idx); });
+    return clusterCache.getOrPut(idx, [=](){ return readCluster(idx, true); });
   }
 
   offset_t FileImpl::getClusterOffset(cluster_index_t idx) const
@@ -376,6 +628,48 @@ offset_t readOffset(const Reader& reader, size_t idx)
     return readOffset(*clusterOffsetReader, idx.v);
   }
 
+  offset_t FileImpl::getClusterEnd(cluster_index_t idx)
+  {
+    return getPartEnd(getClusterOffset(idx));
+  }
+
+  offset_t FileImpl::getPartEnd(offset_t offset)
+  {
+    std::call_once(sortedPartOffsetsOnceFlag, [this](){
+      for (cluster_index_type i = 0; i < getCountClusters().v; ++i) {
+        sortedPartOffsets.push_back(getClusterOffset(cluster_index_t(i)).v);
+      }
+      sortedPartOffsets.push_back(header.getMimeListPos());
+      sortedPartOffsets.push_back(header.getUrlPtrPos());
+      sortedPartOffsets.push_back(header.getTitleIdxPos());
+      sortedPartOffsets.push_back(header.getClusterPtrPos());
+      if (header.hasChecksum())
+        sortedPartOffsets.push_back(header.getChecksumPos());
+      if (getCountArticles().v) {
+        // The dirents are stored together, in url order.
+        sortedPartOffsets.push_back(readOffset(*urlPtrOffsetReader, 0).v);
+      }
+      sortedPartOffsets.push_back(getFilesize().v);
+      std::sort(sortedPartOffsets.begin(), sortedPartOffsets.end());
+    });
+    auto it = std::upper_bound(sortedPartOffsets.begin(), sortedPartOffsets.end(),
+                               offset.v);
+    if (it == sortedPartOffsets.end())
+      throw ZimFileFormatError("Part out of the zim file");
+    return offset_t(*it);
+  }
+
+  Blob FileImpl::getRawCluster(cluster_index_t idx)
+  {
+    auto offset = getClusterOffset(idx);
+    return getRawData(offset, zsize_t(getClusterEnd(idx).v - offset.v));
+  }
+
+  Blob FileImpl::getRawData(offset_t offset, zsize_t size)
+  {
+    return Blob(zimReader->get_buffer(offset, size));
+  }
+
   offset_t FileImpl::getBlobOffset(cluster_index_t clusterIdx, blob_index_t blobIdx)
   {
     auto cluster = getCluster(clusterIdx);
@@ -384,6 +678,24 @@ offset_t readOffset(const Reader& reader, size_t idx)
     return getClusterOffset(clusterIdx) + offset_t(1) + cluster->getBlobOffset(blobIdx);
   }
 
+  zsize_t FileImpl::getBlobSize(cluster_index_t clusterIdx, blob_index_t blobIdx)
+  {
+    if (clusterIdx >= getCountClusters())
+      throw ZimFileFormatError("cluster index out of range");
+
+    auto offsets = blobOffsetsCache.getOrPut(clusterIdx, [=](){
+      auto clusterOffset = getClusterOffset(clusterIdx);
+      const ZSTD_DDict* dict = nullptr;
+      if ((zimReader->read(clusterOffset) & 0x0F) == zimcompZstdDict)
+        dict = getZstdDict();
+      return BlobOffsets(new std::vector<offset_type>(
+        zimReader->read_clusterOffsets(clusterOffset, dict)));
+    });
+    if (blobIdx.v + 1 >= offsets->size())
+      return zsize_t(0);
+    return zsize_t((*offsets)[blobIdx.v + 1] - (*offsets)[blobIdx.v]);
+  }
+
   article_index_t FileImpl::getNamespaceBeginOffset(char ch)
   {
     log_trace("getNamespaceBeginOffset(" << ch << ')');
@@ -459,6 +771,21 @@ offset_t readOffset(const Reader& reader, size_t idx)
     return mimeTypes[idx];
   }
 
+  FileImpl::TemplateHandle FileImpl::getTemplate(article_index_t idx)
+  {
+    return templateCache.getOrPut(idx, [=](){
+      auto dirent = getDirent(idx);
+      Blob data;
+      if (dirent->isArticle())
+        data = getCluster(dirent->getClusterNumber())->getBlob(dirent->getBlobNumber());
+      std::shared_ptr<CompiledTemplate> compiled(new CompiledTemplate(data.data(), data.size()));
+      compiled->resolveLinks([this](char ns, const std::string& url) {
+        return findx(ns, url);
+      });
+      return TemplateHandle(compiled);
+    });
+  }
+
   std::string FileImpl::getChecksum()
   {
     if (!header.hasChecksum())
@@ -541,4 +868,107 @@ offset_t readOffset(const Reader& reader, size_t idx)
   bool FileImpl::is_multiPart() const {
     return zimFile->is_multiPart();
   }
+
+  FileImpl::~FileImpl()
+  {
+    stopPreload = true;
+    waitCacheState();
+  }
+
+  void FileImpl::saveCacheState(const std::string& path)
+  {
+    auto clusters = clusterCache.getKeys();
+    pthread_mutex_lock(&direntCacheLock);
+    auto dirents = direntCache.keys();
+    pthread_mutex_unlock(&direntCacheLock);
+
+    std::ofstream out(path);
+    out << "zim-cache-state 1\n"
+        << header.getUuid() << '\n';
+    for (auto& idx: clusters) {
+      out << "C " << idx.v << '\n';
+    }
+    for (auto& idx: dirents) {
+      out << "D " << idx.v << '\n';
+    }
+    if (!out)
+      throw std::runtime_error("Cannot write cache state to " + path);
+  }
+
+  bool FileImpl::loadCacheState(const std::string& path)
+  {
+    std::ifstream in(path);
+    std::string line;
+    if (!std::getline(in, line) || line != "zim-cache-state 1")
+      return false;
+    std::ostringstream uuid;
+    uuid << header.getUuid();
+    if (!std::getline(in, line) || line != uuid.str())
+      return false;
+
+    std::vector<cluster_index_t> clusters;
+    std::vector<article_index_t> dirents;
+    char kind;
+    uint64_t idx;
+    while (in >> kind >> idx) {
+      if (kind == 'C' && idx < getCountClusters().v)
+        clusters.push_back(cluster_index_t(cluster_index_type(idx)));
+      else if (kind == 'D' && idx < getCountArticles().v)
+        dirents.push_back(article_index_t(article_index_type(idx)));
+    }
+    // Load the most recently used last, to keep it the most recently used.
+    std::reverse(clusters.begin(), clusters.end());
+    std::reverse(dirents.begin(), dirents.end());
+
+    pthread_mutex_lock(&preloadLock);
+    joinPreload();
+    preloadClusters.swap(clusters);
+    preloadDirents.swap(dirents);
+    stopPreload = false;
+    bool started = pthread_create(&preloadThread, NULL, preload, this) == 0;
+    preloading = started;
+    pthread_mutex_unlock(&preloadLock);
+    if (!started)
+      throw std::runtime_error("Cannot start the thread preloading the caches");
+    return true;
+  }
+
+  void FileImpl::waitCacheState()
+  {
+    pthread_mutex_lock(&preloadLock);
+    joinPreload();
+    pthread_mutex_unlock(&preloadLock);
+  }
+
+  void FileImpl::joinPreload()
+  {
+    if (preloading) {
+      pthread_join(preloadThread, nullptr);
+      preloading = false;
+    }
+  }
+
+  void* FileImpl::preload(void* arg)
+  {
+    auto self = static_cast<FileImpl*>(arg);
+    log_debug("preload " << self->preloadClusters.size() << " clusters and "
+              << self->preloadDirents.size() << " dirents");
+    try {
+      // The clusters go through the cluster cache: an access to a cluster
+      // being loaded waits for it instead of loading it again.
+      for (auto idx: self->preloadClusters) {
+        if (self->stopPreload)
+          return nullptr;
+        self->getCluster(idx);
+      }
+      for (auto idx: self->preloadDirents) {
+        if (self->stopPreload)
+          return nullptr;
+        self->getDirent(idx);
+      }
+    } catch (std::exception& e) {
+      log_warn("cannot preload the caches: " << e.what());
+    }
+    return nullptr;
+  }
 }
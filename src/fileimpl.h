@@ -28,6 +28,7 @@
 #include <zim/zim.h>
 #include <zim/fileheader.h>
 #include <mutex>
+#include <atomic>
 #include "lrucache.h"
 #include "concurrent_cache.h"
 #include "_dirent.h"
@@ -35,6 +36,7 @@
 #include "buffer.h"
 #include "file_reader.h"
 #include "file_compound.h"
+#include "template.h"
 #include "zim_types.h"
 
 namespace zim
@@ -53,11 +55,25 @@ namespace zim
       std::unique_ptr<const Reader> clusterOffsetReader;
 
       lru_cache<article_index_t, std::shared_ptr<const Dirent>> direntCache;
-      pthread_mutex_t direntCacheLock;
+      mutable pthread_mutex_t direntCacheLock;
 
       typedef std::shared_ptr<const Cluster> ClusterHandle;
       ConcurrentCache<cluster_index_t, ClusterHandle> clusterCache;
 
+      // The compressed clusters as read from the file, in front of the
+      // (uncompressed) clusters cache. Its size is in bytes.
+      lru_cache<cluster_index_t, std::shared_ptr<const Buffer>> compressedClusterCache;
+      mutable pthread_mutex_t compressedClusterCacheLock;
+
+      // The offsets of the blobs of the clusters, read without uncompressing
+      // the whole cluster.
+      typedef std::shared_ptr<const std::vector<offset_type>> BlobOffsets;
+      ConcurrentCache<cluster_index_t, BlobOffsets> blobOffsetsCache;
+
+      // The templates (layout page and html template articles) compiled.
+      typedef std::shared_ptr<const CompiledTemplate> TemplateHandle;
+      ConcurrentCache<article_index_t, TemplateHandle> templateCache;
+
       bool cacheUncompressedCluster;
       typedef std::map<char, article_index_t> NamespaceCache;
 
@@ -73,8 +89,27 @@ namespace zim
       std::vector<pair_type> articleListByCluster;
       std::once_flag orderOnceFlag;
 
+      std::shared_ptr<const ZSTD_DDict> zstdDict;
+      std::once_flag zstdDictOnceFlag;
+
+      // The start offsets of the clusters and of the other parts of the
+      // file, sorted. A cluster ends where the next part starts.
+      std::vector<offset_type> sortedPartOffsets;
+      std::once_flag sortedPartOffsetsOnceFlag;
+
+      // The clusters and dirents to preload in the background (see
+      // loadCacheState), the least recently used first.
+      std::vector<cluster_index_t> preloadClusters;
+      std::vector<article_index_t> preloadDirents;
+      pthread_t preloadThread;
+      bool preloading;
+      // Guard the preload vectors, preloadThread and preloading.
+      pthread_mutex_t preloadLock;
+      std::atomic<bool> stopPreload;
+
     public:
       explicit FileImpl(const std::string& fname);
+      ~FileImpl();
 
       time_t getMTime() const;
 
@@ -90,13 +125,39 @@ namespace zim
 
       std::pair<bool, article_index_t> findx(char ns, const std::string& url);
       std::pair<bool, article_index_t> findx(const std::string& url);
+      std::vector<std::pair<bool, article_index_t>> findxBatch(const std::vector<std::string>& urls);
       std::pair<bool, article_index_t> findxByTitle(char ns, const std::string& title);
       std::pair<bool, article_index_t> findxByClusterOrder(article_index_type idx);
 
       std::shared_ptr<const Cluster> getCluster(cluster_index_t idx);
+      // Read the cluster from the file, without the cluster cache. The
+      // compressed bytes are taken from (and put in) the compressed cluster
+      // cache only if useCompressedCache.
+      ClusterHandle readCluster(cluster_index_t idx, bool useCompressedCache = false);
       cluster_index_t getCountClusters() const       { return cluster_index_t(header.getClusterCount()); }
       offset_t getClusterOffset(cluster_index_t idx) const;
+      offset_t getClusterEnd(cluster_index_t idx);
+      Blob getRawCluster(cluster_index_t idx);
+      // The offset where the part of the file (cluster, mime list, dirents,
+      // ...) starting at offset ends.
+      offset_t getPartEnd(offset_t offset);
+      Blob getRawData(offset_t offset, zsize_t size);
       offset_t getBlobOffset(cluster_index_t clusterIdx, blob_index_t blobIdx);
+      // The size of a blob, from the offsets of its cluster (kept in
+      // blobOffsetsCache). Only the offsets are uncompressed, the cluster
+      // cache is not used.
+      zsize_t getBlobSize(cluster_index_t clusterIdx, blob_index_t blobIdx);
+      size_type getClusterCacheHits() const    { return clusterCache.getHits(); }
+      size_type getClusterCacheMisses() const  { return clusterCache.getMisses(); }
+      size_type getClusterCacheMaxSize() const  { return clusterCache.getMaxSize(); }
+      void setClusterCacheMaxSize(size_type nbClusters)  { clusterCache.setMaxSize(nbClusters); }
+      size_type getDirentCacheMaxSize() const;
+      void setDirentCacheMaxSize(size_type nbDirents);
+      size_type getCompressedClusterCacheMaxSize() const;
+      void setCompressedClusterCacheMaxSize(size_type nbBytes);
+      size_type getCompressedClusterCacheHits() const;
+      size_type getCompressedClusterCacheMisses() const;
+      size_type getCompressedClusterCacheSize() const;
 
       article_index_t getNamespaceBeginOffset(char ch);
       article_index_t getNamespaceEndOffset(char ch);
@@ -108,12 +169,28 @@ namespace zim
 
       const std::string& getMimeType(uint16_t idx) const;
 
+      // The article idx compiled as a template, with its links resolved.
+      TemplateHandle getTemplate(article_index_t idx);
+
       std::string getChecksum();
       bool verify();
       bool is_multiPart() const;
 
+      // Write the indexes of the cached clusters and dirents to path.
+      void saveCacheState(const std::string& path);
+      // Start to preload the clusters and dirents saved in path in a
+      // background thread. Return false if path is not a cache state of
+      // this file, throw if the thread cannot be started.
+      bool loadCacheState(const std::string& path);
+      // Wait for the end of the preload started by loadCacheState.
+      void waitCacheState();
+
   private:
-      ClusterHandle readCluster(cluster_index_t idx);
+      static void* preload(void* arg);
+      // With preloadLock held.
+      void joinPreload();
+      std::shared_ptr<const Buffer> getCompressedCluster(cluster_index_t idx);
+      const ZSTD_DDict* getZstdDict();
   };
 
 
@@ -38,6 +38,7 @@
 
 #include <map>
 #include <list>
+#include <vector>
 #include <cstddef>
 #include <stdexcept>
 #include <cassert>
@@ -49,6 +50,8 @@ class lru_cache {
 public: // types
   typedef typename std::pair<key_t, value_t> key_value_pair_t;
   typedef typename std::list<key_value_pair_t>::iterator list_iterator_t;
+  // An entry in the list and its cost.
+  typedef typename std::pair<list_iterator_t, size_t> map_value_t;
 
   enum AccessStatus {
     HIT, // key was found in the cache
@@ -79,8 +82,14 @@ public: // types
   };
 
 public: // functions
+  // By default, max_size is a number of values. If the values are put with
+  // a cost (their size in bytes for instance), max_size is the maximum total
+  // cost of the values in the cache.
   explicit lru_cache(size_t max_size) :
-    _max_size(max_size) {
+    _max_size(max_size),
+    _cost(0),
+    _hits(0),
+    _misses(0) {
   }
 
   // If 'key' is present in the cache, returns the associated value,
@@ -89,31 +98,38 @@ public: // functions
   AccessResult getOrPut(const key_t& key, const value_t& value) {
     auto it = _cache_items_map.find(key);
     if (it != _cache_items_map.end()) {
-      _cache_items_list.splice(_cache_items_list.begin(), _cache_items_list, it->second);
-      return AccessResult(it->second->second, HIT);
+      _hits++;
+      _cache_items_list.splice(_cache_items_list.begin(), _cache_items_list, it->second.first);
+      return AccessResult(it->second.first->second, HIT);
     } else {
-      putMissing(key, value);
+      _misses++;
+      putMissing(key, value, 1);
       return AccessResult(value, PUT);
     }
   }
 
-  void put(const key_t& key, const value_t& value) {
+  void put(const key_t& key, const value_t& value, size_t cost = 1) {
     auto it = _cache_items_map.find(key);
     if (it != _cache_items_map.end()) {
-      _cache_items_list.splice(_cache_items_list.begin(), _cache_items_list, it->second);
-      it->second->second = value;
+      _cache_items_list.splice(_cache_items_list.begin(), _cache_items_list, it->second.first);
+      it->second.first->second = value;
+      _cost = _cost - it->second.second + cost;
+      it->second.second = cost;
+      evict();
     } else {
-      putMissing(key, value);
+      putMissing(key, value, cost);
     }
   }
 
   AccessResult get(const key_t& key) {
     auto it = _cache_items_map.find(key);
     if (it == _cache_items_map.end()) {
+      _misses++;
       return AccessResult();
     } else {
-      _cache_items_list.splice(_cache_items_list.begin(), _cache_items_list, it->second);
-      return AccessResult(it->second->second, HIT);
+      _hits++;
+      _cache_items_list.splice(_cache_items_list.begin(), _cache_items_list, it->second.first);
+      return AccessResult(it->second.first->second, HIT);
     }
   }
 
@@ -125,21 +141,63 @@ public: // functions
     return _cache_items_map.size();
   }
 
+  // The keys in the cache, the most recently used first.
+  std::vector<key_t> keys() const {
+    std::vector<key_t> ret;
+    ret.reserve(_cache_items_list.size());
+    for (auto& item: _cache_items_list) {
+      ret.push_back(item.first);
+    }
+    return ret;
+  }
+
+  // The total cost of the values in the cache.
+  size_t cost() const { return _cost; }
+
+  size_t getMaxSize() const { return _max_size; }
+  // Change the maximum size, evicting values right away if it is smaller.
+  void setMaxSize(size_t max_size) {
+    _max_size = max_size;
+    evict();
+  }
+
+  size_t getHits() const { return _hits; }
+  size_t getMisses() const { return _misses; }
+  double hitRatio() const {
+    auto accesses = _hits + _misses;
+    return accesses ? double(_hits) / accesses : 0;
+  }
+  double fillfactor() const {
+    return _max_size ? double(_cost) / _max_size : 0;
+  }
+
 private: // functions
-  void putMissing(const key_t& key, const value_t& value) {
+  void putMissing(const key_t& key, const value_t& value, size_t cost) {
     assert(_cache_items_map.find(key) == _cache_items_map.end());
     _cache_items_list.push_front(key_value_pair_t(key, value));
-    _cache_items_map[key] = _cache_items_list.begin();
-    if (_cache_items_map.size() > _max_size) {
-      _cache_items_map.erase(_cache_items_list.back().first);
+    _cache_items_map[key] = map_value_t(_cache_items_list.begin(), cost);
+    _cost += cost;
+    evict();
+  }
+
+  // Drop the least recently used values until the cost fits in max_size.
+  // A value too costly for the cache is not kept at all.
+  void evict() {
+    while (_cost > _max_size && !_cache_items_list.empty()) {
+      auto it = _cache_items_map.find(_cache_items_list.back().first);
+      _cost -= it->second.second;
+      _cache_items_map.erase(it);
       _cache_items_list.pop_back();
     }
   }
 
 private: // data
   std::list<key_value_pair_t> _cache_items_list;
-  std::map<key_t, list_iterator_t> _cache_items_map;
+  std::map<key_t, map_value_t> _cache_items_map;
   size_t _max_size;
+  size_t _cost;
+  size_t _hits;
+  size_t _misses;
 };
 
 } // namespace zim
@@ -18,6 +18,8 @@
  */
 
 #include "template.h"
+#include "buffer.h"
+#include <algorithm>
 
 namespace zim
 {
@@ -132,6 +134,47 @@ namespace zim
     }
   }
 
+  CompiledTemplate::CompiledTemplate(const char* data, size_type size)
+  {
+    TemplateParser parser(this);
+    for (const char* p = data; p != data + size; ++p)
+      parser.parse(*p);
+    parser.flush();
+    for (auto& segment: segments) {
+      if (segment.type == DATA) {
+        auto buffer = std::make_shared<MemoryBuffer>(zsize_t(segment.data.size()));
+        std::copy(segment.data.begin(), segment.data.end(), buffer->buf());
+        segment.literal = buffer;
+      }
+    }
+  }
+
+  void CompiledTemplate::onData(const std::string& data)
+  {
+    if (data.empty())
+      return;
+    if (!segments.empty() && segments.back().type == DATA) {
+      segments.back().data += data;
+      return;
+    }
+    segments.push_back(Segment{DATA, data, UNKNOWN, '\0', false, 0, nullptr});
+  }
+
+  void CompiledTemplate::onToken(const std::string& token)
+  {
+    Token t = token == "title" ? TITLE
+            : token == "url" ? URL
+            : token == "namespace" ? NAMESPACE
+            : token == "content" ? CONTENT
+            : UNKNOWN;
+    segments.push_back(Segment{TOKEN, token, t, '\0', false, 0, nullptr});
+  }
+
+  void CompiledTemplate::onLink(char ns, const std::string& url)
+  {
+    segments.push_back(Segment{LINK, url, UNKNOWN, ns, false, 0, nullptr});
+  }
+
   void TemplateParser::flush()
   {
     if (event)
@@ -21,9 +21,14 @@
 #define ZIM_TEMPLATE_H
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <zim/zim.h>
 
 namespace zim
 {
+  class Buffer;
+
   class TemplateParser
   {
     public:
@@ -77,6 +82,55 @@ namespace zim
 
       void flush();
   };
+
+  // A template parsed once into the list of its literal data, tokens and
+  // links, to be rendered without parsing it again.
+  class CompiledTemplate : private TemplateParser::Event
+  {
+    public:
+      enum SegmentType { DATA, TOKEN, LINK };
+      enum Token { TITLE, URL, NAMESPACE, CONTENT, UNKNOWN };
+
+      struct Segment
+      {
+        SegmentType type;
+        // The literal data, the name of the token or the url of the link.
+        std::string data;
+        Token token;
+        // The namespace of the link and the article it is resolved to.
+        char ns;
+        bool found;
+        article_index_type index;
+        // A copy of the literal data, for the blobs rendered from it to
+        // outlive the template.
+        std::shared_ptr<const Buffer> literal;
+      };
+
+      CompiledTemplate(const char* data, size_type size);
+
+      // Resolve the links with findx(ns, url), returning a pair<bool, index>
+      // like FileImpl::findx.
+      template<typename F>
+      void resolveLinks(F findx)
+      {
+        for (auto& segment: segments) {
+          if (segment.type == LINK) {
+            auto r = findx(segment.ns, segment.data);
+            segment.found = r.first;
+            segment.index = article_index_type(r.second);
+          }
+        }
+      }
+
+      const std::vector<Segment>& getSegments() const  { return segments; }
+
+    private:
+      void onData(const std::string& data);
+      void onToken(const std::string& token);
+      void onLink(char ns, const std::string& url);
+
+      std::vector<Segment> segments;
+  };
 }
 
 #endif // ZIM_TEMPLATE_H
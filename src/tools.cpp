@@ -27,6 +27,8 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <memory>
+#include <vector>
+#include <stdint.h>
 #include <errno.h>
 
 #include <unicode/translit.h>
@@ -51,19 +53,115 @@
 #endif
 
 
-std::string zim::removeAccents(const std::string& text)
+namespace
+{
+
+// Code points handled without ICU: the Latin blocks (U+0080 - U+024F) and
+// the combining diacritical marks (U+0300 - U+036F), all encoded on two
+// bytes in UTF-8.
+const uint32_t latinTableEnd = 0x370;
+
+void setDefaultConverter()
+{
+  static bool initialized = (ucnv_setDefaultName("UTF-8"), true);
+  (void)initialized;
+}
+
+// Transliterators are not thread safe, each thread uses its own one.
+icu::Transliterator* getRemoveAccentsTransliterator()
+{
+  static thread_local std::unique_ptr<icu::Transliterator> removeAccentsTrans;
+  if (!removeAccentsTrans) {
+    UErrorCode status = U_ZERO_ERROR;
+    removeAccentsTrans.reset(icu::Transliterator::createInstance(
+        "Lower; NFD; [:M:] remove; NFC", UTRANS_FORWARD, status));
+  }
+  return removeAccentsTrans.get();
+}
+
+std::string removeAccentsICU(const char* text)
 {
-  ucnv_setDefaultName("UTF-8");
-  static UErrorCode status = U_ZERO_ERROR;
-  static std::unique_ptr<icu::Transliterator> removeAccentsTrans(icu::Transliterator::createInstance(
-      "Lower; NFD; [:M:] remove; NFC", UTRANS_FORWARD, status));
-  icu::UnicodeString ustring(text.c_str());
-  removeAccentsTrans->transliterate(ustring);
+  setDefaultConverter();
+  icu::UnicodeString ustring(text);
+  getRemoveAccentsTransliterator()->transliterate(ustring);
   std::string unaccentedText;
   ustring.toUTF8String(unaccentedText);
   return unaccentedText;
 }
 
+// The result of removeAccents for each code point of the Latin table.
+// Diacritical marks and lowercase/NFC of the remaining characters do not
+// interact between these characters, so a text made only of them can be
+// transformed code point by code point.
+const std::vector<std::string>& getLatinTable()
+{
+  static const std::vector<std::string> latinTable = []() {
+    std::vector<std::string> table(latinTableEnd);
+    for (uint32_t c = 0x80; c < latinTableEnd; ++c) {
+      char utf8[3] = { char(0xC0 | (c >> 6)), char(0x80 | (c & 0x3F)), 0 };
+      table[c] = removeAccentsICU(utf8);
+    }
+    return table;
+  }();
+  return latinTable;
+}
+
+// Return true if the first size bytes of text are all ASCII, checking a
+// word at a time.
+bool isAscii(const char* text, size_t size)
+{
+  const uint64_t highBits = 0x8080808080808080ULL;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, text + i, sizeof(word));
+    if (word & highBits)
+      return false;
+  }
+  for (; i < size; ++i) {
+    if (text[i] & 0x80)
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+std::string zim::removeAccents(const std::string& text)
+{
+  // As the ICU conversion, stop at the first null character.
+  const char* data = text.c_str();
+  const size_t size = strlen(data);
+
+  std::string unaccentedText;
+  unaccentedText.reserve(size);
+  if (isAscii(data, size)) {
+    for (size_t i = 0; i < size; ++i) {
+      unaccentedText += (data[i] >= 'A' && data[i] <= 'Z') ? data[i] + ('a' - 'A') : data[i];
+    }
+    return unaccentedText;
+  }
+
+  const auto& latinTable = getLatinTable();
+  for (size_t i = 0; i < size; ++i) {
+    unsigned char c = data[i];
+    if (c < 0x80) {
+      unaccentedText += (c >= 'A' && c <= 'Z') ? char(c + ('a' - 'A')) : char(c);
+      continue;
+    }
+    if (c >= 0xC2 && c < 0xE0 && i + 1 < size && (data[i+1] & 0xC0) == 0x80) {
+      uint32_t codePoint = ((c & 0x1F) << 6) | (data[i+1] & 0x3F);
+      if (codePoint < latinTableEnd) {
+        unaccentedText += latinTable[codePoint];
+        ++i;
+        continue;
+      }
+    }
+    // Not in the table, let ICU do the full work.
+    return removeAccentsICU(data);
+  }
+  return unaccentedText;
+}
 
 void zim::microsleep(int microseconds) {
 #ifdef __MINGW32__
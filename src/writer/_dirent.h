@@ -125,6 +125,14 @@ namespace zim
           info.d.blobNumber = _cluster->count();
         }
 
+        // Point to a blob already stored in the cluster.
+        void setCluster(zim::writer::Cluster* _cluster, blob_index_t blobNumber)
+        {
+          ASSERT(isArticle(), ==, true);
+          cluster = _cluster;
+          info.d.blobNumber = blobNumber;
+        }
+
         cluster_index_t getClusterNumber() const {
           return cluster ? cluster->getClusterIndex() : info.d.clusterNumber;
         }
@@ -139,7 +147,8 @@ namespace zim
         uint16_t getMimeType() const            { return mimeType; }
         size_t getDirentSize() const
         {
-          size_t ret = (isRedirect() ? 12 : 16) + url.getUrl().size() + 2;
+          size_t ret = (isRedirect() ? 12 : (isLinktarget() || isDeleted()) ? 8 : 16)
+                     + url.getUrl().size() + 2;
           if (title != url.getUrl())
             ret += title.size();
           return ret;
@@ -157,6 +166,7 @@ namespace zim
         }
 
         void write(int out_fd) const;
+        void write(writer_t writer) const;
 
         friend bool compareUrl(const Dirent* d1, const Dirent* d2);
         friend inline bool compareTitle(const Dirent* d1, const Dirent* d2);
@@ -17,6 +17,8 @@
  *
  */
 
+#include "config.h"
+
 #include "cluster.h"
 #include "../log.h"
 #include "../endian_tools.h"
@@ -36,13 +38,106 @@
 # define _write(fd, addr, size) ::write((fd), (addr), (size))
 #endif
 
+#if defined(HAVE_SENDFILE)
+# include <sys/sendfile.h>
+#endif
+
 namespace zim {
 namespace writer {
 
-Cluster::Cluster(CompressionType compression)
+class ClusterCompressor {
+  public:
+    virtual ~ClusterCompressor() = default;
+    virtual void feed(const char* data, size_t size) = 0;
+    virtual std::unique_ptr<char[]> get_data(zsize_t* size) = 0;
+    virtual size_t memory_size() const = 0;
+};
+
+namespace {
+
+template<typename COMP_INFO>
+class ClusterCompressorImpl : public ClusterCompressor {
+  public:
+    template<typename... Args>
+    explicit ClusterCompressorImpl(size_t initial_size, Args&&... args)
+      : runner(initial_size)
+    {
+      runner.init(nullptr, std::forward<Args>(args)...);
+    }
+
+    void feed(const char* data, size_t size) {
+      if (runner.feed(data, size) == RunnerStatus::ERROR) {
+        throw std::runtime_error(std::string("Error while compressing ")
+                                 + COMP_INFO::name + " stream");
+      }
+    }
+
+    std::unique_ptr<char[]> get_data(zsize_t* size) {
+      return runner.get_data(size);
+    }
+
+    size_t memory_size() const {
+      return runner.memory_size();
+    }
+
+  private:
+    Compressor<COMP_INFO> runner;
+};
+
+/* Copy the content of the file to out_fd, in the kernel when possible.
+ * What cannot be copied this way (other file systems, old kernels, ...) is
+ * passed to writer.
+ */
+void copy_file(const std::string& filename, int out_fd, writer_t writer)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw std::runtime_error(std::string("cannot open ") + filename);
+  }
+  const size_t chunk_size = 1024*1024*1024;
+  bool eof = false;
+#if defined(HAVE_COPY_FILE_RANGE)
+  while (!eof) {
+    auto r = copy_file_range(fd, nullptr, out_fd, nullptr, chunk_size, 0);
+    if (r == -1)
+      break;
+    eof = (r == 0);
+  }
+#endif
+#if defined(HAVE_SENDFILE)
+  while (!eof) {
+    auto r = sendfile(out_fd, fd, nullptr, chunk_size);
+    if (r == -1)
+      break;
+    eof = (r == 0);
+  }
+#endif
+  if (!eof) {
+    // Both calls keep the offset of fd where they stopped.
+    std::unique_ptr<char[]> buffer(new char[1024*1024]);
+    while (true) {
+      auto r = read(fd, buffer.get(), 1024*1024);
+      if (r == -1) {
+        ::close(fd);
+        throw std::runtime_error(std::string("cannot read ") + filename);
+      }
+      if (!r)
+        break;
+      writer(Blob(buffer.get(), r));
+    }
+  }
+  ::close(fd);
+}
+
+} // namespace
+
+Cluster::Cluster(CompressionType compression, bool streaming)
   : compression(compression),
     isExtended(false),
-    _size(0)
+    _size(0),
+    streaming(streaming
+              && compression != zim::zimcompDefault
+              && compression != zim::zimcompNone)
 {
   blobOffsets.push_back(offset_t(0));
   pthread_mutex_init(&m_closedMutex,NULL);
@@ -63,6 +158,8 @@ void Cluster::clear_data() {
 void Cluster::clear_raw_data() {
   Offsets().swap(blobOffsets);
   ClusterData().swap(_data);
+  plainDataSize = 0;
+  rawCluster = Blob();
 }
 
 void Cluster::clear_compressed_data() {
@@ -72,14 +169,33 @@ void Cluster::clear_compressed_data() {
   }
 }
 
+void Cluster::setRawCluster(const Blob& data)
+{
+  if (data.size() == 0) {
+    throw std::runtime_error("Cannot copy an empty cluster");
+  }
+  char clusterInfo = data.data()[0];
+  compression = static_cast<CompressionType>(clusterInfo & 0x0F);
+  isExtended = (clusterInfo & 0x10) != 0;
+  copied = true;
+  rawCluster = data;
+}
+
 void Cluster::close() {
-  if (getCompression() != zim::zimcompDefault
+  if (copied) {
+    // Nothing to compress.
+  } else if (streaming) {
+    // Content is already compressed, only the offsets remain.
+    compress_streamed();
+    clear_raw_data();
+  } else if (getCompression() != zim::zimcompDefault
     && getCompression() != zim::zimcompNone) {
 
     // We must compress the content in a buffer.
     compress();
     clear_raw_data();
   }
+  closedMemorySize = getMemorySize();
   pthread_mutex_lock(&m_closedMutex);
   closed = true;
   pthread_mutex_unlock(&m_closedMutex);
@@ -105,6 +221,16 @@ zsize_t Cluster::size() const
   }
 }
 
+zim::size_type Cluster::getMemorySize() const
+{
+  auto size = compressed_data.size() + rawCluster.size() + plainDataSize;
+  if (streamCompressor) {
+    // The state of the encoder and the data compressed so far.
+    size += streamCompressor->memory_size();
+  }
+  return size;
+}
+
 template<typename OFFSET_TYPE>
 void Cluster::write_offsets(writer_t writer) const
 {
@@ -118,17 +244,17 @@ void Cluster::write_offsets(writer_t writer) const
   }
 }
 
-void Cluster::write_content(writer_t writer) const
+void Cluster::write_content(writer_t writer, int out_fd) const
 {
   if (isExtended) {
     write_offsets<uint64_t>(writer);
   } else {
     write_offsets<uint32_t>(writer);
   }
-  write_data(writer);
+  write_data(writer, out_fd);
 }
 
-void Cluster::compress()
+std::unique_ptr<ClusterCompressor> Cluster::makeCompressor(size_t initial_size, const CompressionOptions& options) const
 {
   auto comp = getCompression();
   switch(comp) {
@@ -142,55 +268,105 @@ void Cluster::compress()
       }
 
     case zim::zimcompLzma:
-      {
-        _compress<LZMA_INFO>();
-        break;
-      }
+      return std::unique_ptr<ClusterCompressor>(new ClusterCompressorImpl<LZMA_INFO>(initial_size, options));
 
 #if defined(ENABLE_ZLIB)
     case zim::zimcompZip:
-      {
-        _compress<ZIP_INFO>();
-        break;
-      }
+      return std::unique_ptr<ClusterCompressor>(new ClusterCompressorImpl<ZIP_INFO>(initial_size, options));
 #endif
 
     case zim::zimcompZstd:
-      {
-        _compress<ZSTD_INFO>();
-        break;
+      return std::unique_ptr<ClusterCompressor>(new ClusterCompressorImpl<ZSTD_INFO>(initial_size, options));
+
+    case zim::zimcompZstdDict:
+      if (!zstdDict) {
+        throw std::logic_error("No dictionary to compress the cluster");
       }
+      return std::unique_ptr<ClusterCompressor>(new ClusterCompressorImpl<ZSTD_INFO>(initial_size, zstdDict.get(), options));
 
     default:
       throw std::runtime_error("We cannot compress an uncompressed cluster");
   };
 }
 
-template<typename COMP_TYPE>
-void Cluster::_compress()
+void Cluster::compress()
 {
-  Compressor<COMP_TYPE> runner;
-  bool first = true;
+  auto runner = makeCompressor(1024*1024, compressionOptions);
   auto writer = [&](const Blob& data) -> void {
-    if (first) {
-      runner.init((char*)data.data());
-      first = false;
-    }
-    runner.feed(data.data(), data.size());
+    runner->feed(data.data(), data.size());
   };
   write_content(writer);
   zsize_t size;
-  auto comp = runner.get_data(&size);
+  auto comp = runner->get_data(&size);
   compressed_data = Blob(comp.release(), size.v);
 }
 
+void Cluster::compress_streamed()
+{
+  // The offsets are known only now, they are compressed in their own stream
+  // which is put in front of the (already compressed) data stream.
+  // They are a few KB, a fast encoder with a small window is enough.
+  CompressionOptions headerOptions;
+  headerOptions.level = 1;
+  headerOptions.windowLog = 16;
+  auto headerRunner = makeCompressor(blobOffsets.size() * sizeof(uint64_t) + 1024, headerOptions);
+  auto writer = [&](const Blob& data) -> void {
+    headerRunner->feed(data.data(), data.size());
+  };
+  if (isExtended) {
+    write_offsets<uint64_t>(writer);
+  } else {
+    write_offsets<uint32_t>(writer);
+  }
+  zsize_t headerSize;
+  auto header = headerRunner->get_data(&headerSize);
+
+  if (!streamCompressor) {
+    streamCompressor = makeCompressor(1024, compressionOptions);
+  }
+  zsize_t dataSize;
+  auto data = streamCompressor->get_data(&dataSize);
+  streamCompressor.reset();
+
+  char* comp = new char[headerSize.v + dataSize.v];
+  memcpy(comp, header.get(), headerSize.v);
+  memcpy(comp + headerSize.v, data.get(), dataSize.v);
+  compressed_data = Blob(comp, headerSize.v + dataSize.v);
+}
+
+void Cluster::stream_data(const char* data, size_type size)
+{
+  if (!streamCompressor) {
+    streamCompressor = makeCompressor(1024*1024, compressionOptions);
+  }
+  streamCompressor->feed(data, size);
+}
+
 void Cluster::write(int out_fd) const
 {
+  if (copied) {
+    size_type to_write = rawCluster.size();
+    const char* src = rawCluster.data();
+    while (to_write) {
+      auto ret = _write(out_fd, src, to_write);
+      if (ret == -1) {
+        throw std::runtime_error("Error writing");
+      }
+      src += ret;
+      to_write -= ret;
+    }
+    return;
+  }
+
   // write clusterInfo
   char clusterInfo = 0;
   if (isExtended) {
     clusterInfo = 0x10;
   }
+  if (streaming) {
+    // offsets and data are compressed in two streams.
+    clusterInfo |= 0x20;
+  }
   clusterInfo += getCompression();
   if (_write(out_fd, &clusterInfo, 1) == -1) {
     throw std::runtime_error("Error writng");
@@ -216,7 +392,8 @@ void Cluster::write(int out_fd) const
          to_write -= ret;
         }
       };
-      write_content(writer);
+      // The content of the files goes directly to out_fd.
+      write_content(writer, out_fd);
       break;
     }
 
@@ -224,6 +401,7 @@ void Cluster::write(int out_fd) const
     case zim::zimcompBzip2:
     case zim::zimcompLzma:
     case zim::zimcompZstd:
+    case zim::zimcompZstdDict:
       {
         log_debug("compress data");
         if (_write(out_fd, compressed_data.data(), compressed_data.size()) == -1) {
@@ -250,8 +428,21 @@ void Cluster::addArticle(const zim::writer::Article* article)
   if (size == 0)
     return;
 
+  if (streaming) {
+    if (filename.empty()) {
+      auto data = article->getData();
+      stream_data(data.data(), data.size());
+    } else {
+      write_file(filename, [=](const Blob& data) -> void {
+        stream_data(data.data(), data.size());
+      });
+    }
+    return;
+  }
+
   if (filename.empty()) {
     _data.emplace_back(DataType::plain, article->getData());
+    plainDataSize += _data.back().value.size();
   }
   else {
     _data.emplace_back(DataType::file, filename);
@@ -266,33 +457,46 @@ void Cluster::addData(const char* data, zsize_t size)
   if (size.v == 0)
     return;
 
+  if (streaming) {
+    stream_data(data, size.v);
+    return;
+  }
+
   _data.emplace_back(DataType::plain, data, size.v);
+  plainDataSize += size.v;
 }
 
-void Cluster::write_data(writer_t writer) const
+void Cluster::write_data(writer_t writer, int out_fd) const
 {
   for (auto& data: _data)
   {
     ASSERT(data.value.empty(), ==, false);
     if (data.type == DataType::plain) {
       writer(Blob(data.value.c_str(), data.value.size()));
+    } else if (out_fd != -1) {
+      copy_file(data.value, out_fd, writer);
     } else {
-      int fd = open(data.value.c_str(), O_RDONLY);
-      if (fd == -1) {
-        throw std::runtime_error(std::string("cannot open ") + data.value);
-      }
-      char* buffer = new char[1024*1024];
-      while (true) {
-        auto r = read(fd, buffer, 1024*1024);
-        if (!r)
-          break;
-        writer(Blob(buffer, r));
-      }
-      delete [] buffer;
-      ::close(fd);
+      write_file(data.value, writer);
     }
   }
 }
 
+void Cluster::write_file(const std::string& filename, writer_t writer)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw std::runtime_error(std::string("cannot open ") + filename);
+  }
+  char* buffer = new char[1024*1024];
+  while (true) {
+    auto r = read(fd, buffer, 1024*1024);
+    if (!r)
+      break;
+    writer(Blob(buffer, r));
+  }
+  delete [] buffer;
+  ::close(fd);
+}
+
 } // writer
 } // zim
@@ -26,10 +26,13 @@
 #include <vector>
 #include <pthread.h>
 #include <functional>
+#include <memory>
 
 #include <zim/writer/article.h>
 #include "../zim_types.h"
 
+typedef struct ZSTD_CDict_s ZSTD_CDict;
+
 namespace zim {
 
 namespace writer {
@@ -46,23 +49,40 @@ struct Data {
 
 using writer_t = std::function<void(const Blob& data)>;
 
+class ClusterCompressor;
+
 class Cluster {
   typedef std::vector<offset_t> Offsets;
   typedef std::vector<Data> ClusterData;
 
 
   public:
-    Cluster(CompressionType compression);
+    /* If streaming is true (and the cluster is compressed), data is compressed
+     * as articles are added instead of being buffered until the close of the
+     * cluster. Offsets are then compressed in their own stream at close.
+     */
+    Cluster(CompressionType compression, bool streaming = false);
     virtual ~Cluster();
 
     void setCompression(CompressionType c) { compression = c; }
     CompressionType getCompression() const { return compression; }
 
+    // The dictionary used to compress zimcompZstdDict clusters.
+    void setZstdDictionary(std::shared_ptr<const ZSTD_CDict> dict) { zstdDict = dict; }
+    const CompressionOptions& getCompressionOptions() const { return compressionOptions; }
+    void setCompressionOptions(const CompressionOptions& options) { compressionOptions = options; }
+
     void addArticle(const zim::writer::Article* article);
     void addData(const char* data, zsize_t size);
 
     blob_index_t count() const  { return blob_index_t(blobOffsets.size() - 1); }
     zsize_t size() const;
+    // The size of the content of the blobs, still valid once closed.
+    zsize_t getDataSize() const { return _size; }
+    // The memory held by the content of the cluster (raw and compressed).
+    zim::size_type getMemorySize() const;
+    // The memory held once the cluster is closed, until it is written.
+    zim::size_type getClosedMemorySize() const { return closedMemorySize; }
     offset_t getOffset() const { return offset; }
     void setOffset(offset_t o) { offset = o; }
     bool is_extended() const { return isExtended; }
@@ -70,6 +90,14 @@ class Cluster {
     void close();
     bool isClosed() const;
 
+    bool is_streaming() const { return streaming; }
+
+    /* Make this cluster a copy of a cluster of another zim file, as stored
+     * (info byte and compressed content). The cluster is written as is.
+     */
+    void setRawCluster(const Blob& data);
+    bool isCopied() const { return copied; }
+
     void setClusterIndex(cluster_index_t idx) { index = idx; }
     cluster_index_t getClusterIndex() const { return index; }
 
@@ -78,6 +106,9 @@ class Cluster {
 
     void write(int out_fd) const;
 
+    // Pass the content of the file to writer, by chunks.
+    static void write_file(const std::string& filename, writer_t writer);
+
   protected:
     CompressionType compression;
     cluster_index_t index;
@@ -90,15 +121,25 @@ class Cluster {
     std::string tmp_filename;
     mutable pthread_mutex_t m_closedMutex;
     bool closed = false;
+    zim::size_type closedMemorySize = 0;
+    // The size of the plain data in _data.
+    zim::size_type plainDataSize = 0;
+    bool streaming;
+    std::unique_ptr<ClusterCompressor> streamCompressor;
+    std::shared_ptr<const ZSTD_CDict> zstdDict;
+    CompressionOptions compressionOptions;
+    bool copied = false;
+    Blob rawCluster;
 
   private:
-    void write_content(writer_t writer) const;
+    void write_content(writer_t writer, int out_fd = -1) const;
     template<typename OFFSET_TYPE>
     void write_offsets(writer_t writer) const;
-    void write_data(writer_t writer) const;
+    void write_data(writer_t writer, int out_fd = -1) const;
+    void stream_data(const char* data, size_type size);
+    std::unique_ptr<ClusterCompressor> makeCompressor(size_t initial_size, const CompressionOptions& options) const;
     void compress();
-    template<typename COMP_INFO>
-    void _compress();
+    void compress_streamed();
     void clear_raw_data();
     void clear_compressed_data();
 };
@@ -0,0 +1,68 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include <zim/writer/clusteringStrategy.h>
+
+namespace zim
+{
+  namespace writer
+  {
+    std::string ClusteringStrategy::getGroupKey(const Article* article) const
+    {
+      return std::string();
+    }
+
+    bool ClusteringStrategy::isFull(zim::size_type clusterSize,
+                                    zim::size_type blobCount,
+                                    zim::size_type articleSize,
+                                    zim::size_type chunkSize) const
+    {
+      return clusterSize + articleSize >= chunkSize;
+    }
+
+    std::string MimetypeClusteringStrategy::getGroupKey(const Article* article) const
+    {
+      return article->getMimeType();
+    }
+
+    std::string UrlPrefixClusteringStrategy::getGroupKey(const Article* article) const
+    {
+      auto url = article->getUrl();
+      const auto& path = url.getUrl();
+      std::string::size_type end = 0;
+      for (unsigned i = 0; i < depth; ++i) {
+        // The last component is the article name, not a prefix.
+        auto pos = path.find('/', end);
+        if (pos == std::string::npos)
+          break;
+        end = pos + 1;
+      }
+      return std::string(1, url.getNs()) + '/' + path.substr(0, end);
+    }
+
+    bool SizeClusteringStrategy::isFull(zim::size_type clusterSize,
+                                        zim::size_type blobCount,
+                                        zim::size_type articleSize,
+                                        zim::size_type chunkSize) const
+    {
+      if (maxBlobCount && blobCount >= maxBlobCount) {
+        return true;
+      }
+      return clusterSize + articleSize >= targetSize;
+    }
+  }
+}
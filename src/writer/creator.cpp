@@ -24,11 +24,14 @@
 #include "debug.h"
 #include "workers.h"
 #include <zim/blob.h>
+#include <zim/file.h>
 #include <zim/writer/creator.h>
 #include "../endian_tools.h"
 #include <algorithm>
 #include <fstream>
 #include "../md5.h"
+#include "../compression.h"
+#include "../cluster.h"
 
 #if defined(ENABLE_XAPIAN)
   #include "xapianIndexer.h"
@@ -46,9 +49,11 @@
 #include <stdio.h>
 #include <fcntl.h>
 #include <limits>
+#include <cstring>
 #include <stdexcept>
 #include <sstream>
 #include <ctime>
+#include <thread>
 #include "log.h"
 #include "../fs.h"
 #include "../tools.h"
@@ -70,10 +75,135 @@ log_define("zim.writer.creator")
 
 #define CLUSTER_BASE_OFFSET 1024
 
+// Maximum size of the trained zstd dictionary and of the samples used to
+// train it. Zstd advises samples about 100 times the dictionary size.
+#define ZSTD_DICT_MAX_SIZE (110*1024)
+#define ZSTD_DICT_SAMPLES_SIZE (100*ZSTD_DICT_MAX_SIZE)
+#define ZSTD_DICT_MAX_SAMPLE_SIZE (128*1024)
+
+// Maximum number of clusters filled at the same time. When a clustering
+// strategy creates more groups, the least recently used cluster is closed.
+#define MAX_OPEN_CLUSTERS 16
+
+// Maximum number of streaming clusters filled at the same time, over all the
+// producers. Each one holds an encoder, other clusters are buffered.
+#define MAX_STREAMING_CLUSTERS 4
+
+// The open clusters of a producer are closed when it has not added any
+// article while this number of articles were added.
+#define IDLE_PRODUCER_ARTICLES 4096
+
+// Number of titles indexed by each title indexing task.
+#define TITLE_INDEX_BATCH_SIZE 1024
+
+// Size of the buffer used to write the end of the file and to read the
+// clusters back to compute the checksum.
+#define WRITE_BUFFER_SIZE (4*1024*1024)
+
 namespace zim
 {
   namespace writer
   {
+    namespace
+    {
+
+    class ZstdDictionaryArticle : public Article
+    {
+        const std::string& dictionary;
+
+      public:
+        explicit ZstdDictionaryArticle(const std::string& dictionary)
+          : dictionary(dictionary)
+        {}
+
+        virtual Url getUrl() const { return Url('M', "ZstdDictionary"); }
+        virtual std::string getTitle() const { return ""; }
+        virtual bool isRedirect() const { return false; }
+        virtual std::string getMimeType() const { return "application/octet-stream"; }
+        virtual bool shouldCompress() const { return false; }
+        virtual bool shouldIndex() const { return false; }
+        virtual Url getRedirectUrl() const { return Url(); }
+        virtual zim::size_type getSize() const { return dictionary.size(); }
+        virtual Blob getData() const { return Blob(dictionary.data(), dictionary.size()); }
+        virtual std::string getFilename() const { return ""; }
+    };
+
+    // Write to a file through a buffer, updating a md5 checksum with all the
+    // data written.
+    class BufferedWriter
+    {
+        int out_fd;
+        struct zim_MD5_CTX* md5ctx;
+        std::vector<char> buffer;
+
+      public:
+        BufferedWriter(int out_fd, struct zim_MD5_CTX* md5ctx)
+          : out_fd(out_fd),
+            md5ctx(md5ctx)
+        {
+          buffer.reserve(WRITE_BUFFER_SIZE);
+        }
+
+        void write(const char* data, size_t size)
+        {
+          if (buffer.size() + size > WRITE_BUFFER_SIZE) {
+            flush();
+          }
+          buffer.insert(buffer.end(), data, data + size);
+        }
+
+        void flush()
+        {
+          if (buffer.empty())
+            return;
+          zim_MD5Update(md5ctx, reinterpret_cast<unsigned char*>(buffer.data()), buffer.size());
+          _write(out_fd, buffer.data(), buffer.size());
+          buffer.clear();
+        }
+    };
+
+    // The md5 digest of the content of article. Plain content is kept in
+    // data, to be added to the cluster without reading it again.
+    std::string contentDigest(const Article* article, Blob* data, bool* dataRead)
+    {
+      struct zim_MD5_CTX md5ctx;
+      zim_MD5Init(&md5ctx);
+      auto filename = article->getFilename();
+      if (filename.empty()) {
+        if (!*dataRead) {
+          *data = article->getData();
+          *dataRead = true;
+        }
+        zim_MD5Update(&md5ctx, reinterpret_cast<const unsigned char*>(data->data()), data->size());
+      } else {
+        Cluster::write_file(filename, [&](const Blob& chunk) -> void {
+          zim_MD5Update(&md5ctx, reinterpret_cast<const unsigned char*>(chunk.data()), chunk.size());
+        });
+      }
+      unsigned char digest[16];
+      zim_MD5Final(digest, &md5ctx);
+      return std::string(reinterpret_cast<char*>(digest), 16);
+    }
+
+    int defaultCompressionLevel(CompressionType compression)
+    {
+      switch (compression) {
+        case zimcompLzma:
+          return LZMA_INFO::default_level();
+#if defined(ENABLE_ZLIB)
+        case zimcompZip:
+          return ZIP_INFO::default_level();
+#endif
+        case zimcompZstd:
+        case zimcompZstdDict:
+          return ZSTD_INFO::default_level();
+        default:
+          return 0;
+      }
+    }
+
+    } // namespace
+
     Creator::Creator(bool verbose, CompressionType c)
       : verbose(verbose)
       , compression(c)
@@ -83,8 +213,17 @@ namespace zim
 
     void Creator::startZimCreation(const std::string& fname)
     {
-      data = std::unique_ptr<CreatorData>(new CreatorData(fname, verbose, withIndex, indexingLanguage, compression));
+      data = std::unique_ptr<CreatorData>(new CreatorData(fname, verbose, withIndex, indexingLanguage, compression, streamingCompression));
       data->setMinChunkSize(minChunkSize);
+      if (clusteringStrategy)
+        data->clusteringStrategy = clusteringStrategy;
+      data->deduplication = deduplication;
+      data->setCompressionOptions(compressionOptions, adaptiveCompression);
+      data->setMaxBytesInFlight(maxBytesInFlight);
+      data->statsCallback = statsCallback;
+      data->statsPeriod = statsPeriod;
+      if (deltaBase)
+        data->setDeltaBase(deltaBase);
 
       for(unsigned i=0; i<nbWorkerThreads; i++)
       {
@@ -96,45 +235,25 @@ namespace zim
       pthread_create(&data->writerThread, NULL, clusterWriter, this->data.get());
     }
 
+    CreatorStats Creator::getStats() const
+    {
+      if (!data)
+        return CreatorStats();
+      return data->getStats();
+    }
+
+    void Creator::setDeltaBase(const File& base)
+    {
+      deltaBase = std::make_shared<const File>(base);
+    }
+
     void Creator::addArticle(std::shared_ptr<Article> article)
     {
-      auto dirent = data->createDirentFromArticle(article.get());
-      data->addDirent(dirent, article.get());
-      data->nbArticles++;
-      if (article->isRedirect()) {
-        data->nbRedirectArticles++;
-      } else {
-        if (article->shouldCompress())
-          data->nbCompArticles++;
-        else
-          data->nbUnCompArticles++;
-        if (!article->getFilename().empty())
-          data->nbFileArticles++;
-        if (article->shouldIndex())
-          data->nbIndexArticles++;
-      }
-      if (verbose && data->nbArticles%1000 == 0){
-        double seconds = difftime(time(NULL),data->start_time);
-        std::cout << "T:" << (int)seconds
-                  << "; A:" << data->nbArticles
-                  << "; RA:" << data->nbRedirectArticles
-                  << "; CA:" << data->nbCompArticles
-                  << "; UA:" << data->nbUnCompArticles
-                  << "; FA:" << data->nbFileArticles
-                  << "; IA:" << data->nbIndexArticles
-                  << "; C:" << data->nbClusters
-                  << "; CC:" << data->nbCompClusters
-                  << "; UC:" << data->nbUnCompClusters
-                  << "; WC:" << data->taskList.size()
-                  << std::endl;
-      }
+      data->addArticle(article.get());
 
 #if defined(ENABLE_XAPIAN)
-      if (article->shouldIndex()) {
-        data->titleIndexer.index(article.get());
-        if(withIndex && !article->isRedirect()) {
-          data->taskList.pushToQueue(new IndexTask(article));
-        }
+      if (withIndex && article->shouldIndex() && !article->isRedirect()) {
+        data->taskList.pushToQueue(new IndexTask(article));
       }
 #endif
     }
@@ -142,35 +261,30 @@ namespace zim
     void Creator::finishZimCreation()
     {
       if (verbose) {
-        double seconds = difftime(time(NULL),data->start_time);
-        std::cout << "T:" << (int)seconds
-                  << "; A:" << data->nbArticles
-                  << "; RA:" << data->nbRedirectArticles
-                  << "; CA:" << data->nbCompArticles
-                  << "; UA:" << data->nbUnCompArticles
-                  << "; FA:" << data->nbFileArticles
-                  << "; IA:" << data->nbIndexArticles
-                  << "; C:" << data->nbClusters
-                  << "; CC:" << data->nbCompClusters
-                  << "; UC:" << data->nbUnCompClusters
-                  << "; WC:" << data->taskList.size()
-                  << std::endl;
+        data->printStats();
       }
 
+#if defined(ENABLE_XAPIAN)
+      if (!data->titlesToIndex.empty()) {
+        data->taskList.pushToQueue(new TitleIndexTask(std::move(data->titlesToIndex)));
+        data->titlesToIndex.clear();
+      }
+#endif
+
       // We need to wait that all indexation task has been done before closing the
       // xapian database and add it to zim.
       unsigned int wait = 0;
       do {
         microsleep(wait);
         wait += 10;
-      } while(IndexTask::waiting_task.load() > 0);
+      } while(IndexTask::waiting_task.load() > 0
+           || TitleIndexTask::waiting_task.load() > 0);
 
 #if defined(ENABLE_XAPIAN)
       {
         data->titleIndexer.indexingPostlude();
         auto article = data->titleIndexer.getMetaArticle();
-        auto dirent = data->createDirentFromArticle(article);
-        data->addDirent(dirent, article);
+        data->addArticle(article);
         delete article;
       }
       if (withIndex) {
@@ -183,18 +297,27 @@ namespace zim
         data->indexer->indexingPostlude();
         microsleep(100);
         auto article = data->indexer->getMetaArticle();
-        auto dirent = data->createDirentFromArticle(article);
-        data->addDirent(dirent, article);
+        data->addArticle(article);
         delete article;
       }
 #endif
 
-      // When we've seen all articles, write any remaining clusters.
-      if (data->compCluster->count())
-        data->closeCluster(true);
+      if (data->zstdDictPending) {
+        data->trainZstdDictionary();
+      }
+      if (!data->zstdDictionary.empty()) {
+        TINFO("Zstd dictionary of " << data->zstdDictionary.size() << " bytes");
+        ZstdDictionaryArticle article(data->zstdDictionary);
+        data->addArticle(&article);
+      }
 
-      if (data->uncompCluster->count())
-        data->closeCluster(false);
+      if (data->deltaBase) {
+        TINFO("Add the content reused from the delta base");
+        data->addReusedBlobs();
+      }
+
+      // When we've seen all articles, write any remaining clusters.
+      data->closeOpenClusters();
 
       TINFO("Waiting for workers");
       // wait all cluster compression has been done
@@ -202,6 +325,7 @@ namespace zim
       do {
         microsleep(wait);
         wait += 10;
+        data->reportStats(false);
       } while(ClusterTask::waiting_task.load() > 0);
 
       // Quit all workerThreads
@@ -216,6 +340,22 @@ namespace zim
       data->clusterToWrite.pushToQueue(nullptr);
       pthread_join(data->writerThread, nullptr);
 
+      if (data->nbDedupArticles) {
+        TINFO(data->nbDedupArticles << " duplicated articles, "
+              << data->dedupSize << " bytes saved");
+      }
+      if (data->nbReusedArticles) {
+        TINFO(data->nbReusedArticles << " articles reused from the delta base, "
+              << data->nbCopiedClusters << " clusters copied");
+      }
+      if (data->rawCompClustersSize) {
+        TINFO("compressed clusters: " << data->rawCompClustersSize
+              << " bytes compressed to " << data->compClustersSize.load()
+              << " bytes (ratio "
+              << double(data->rawCompClustersSize) / data->compClustersSize.load()
+              << ")");
+      }
+
       TINFO("ResolveRedirectIndexes");
       data->resolveRedirectIndexes();
 
@@ -238,6 +378,7 @@ namespace zim
       DEFAULTFS::rename(data->basename+".zim.tmp", data->basename+".zim");
 
       TINFO("finish");
+      data->reportStats(true);
     }
 
     void Creator::fillHeader(Fileheader* header) const
@@ -285,8 +426,28 @@ namespace zim
 
       int out_fd = data->out_fd;
 
-      lseek(out_fd, header.getMimeListPos(), SEEK_SET);
+      // All sizes are known, compute the layout of the end of the file.
+      offset_type clustersEnd = lseek(out_fd, 0, SEEK_END);
+      offset_type offset = clustersEnd;
+      for (Dirent* dirent: data->dirents)
+      {
+        dirent->setOffset(offset_t(offset));
+        offset += dirent->getDirentSize();
+      }
+      header.setUrlPtrPos(offset);
+      offset += data->dirents.size() * sizeof(offset_type);
+      header.setTitleIdxPos(offset);
+      offset += data->titleIdx.size() * sizeof(article_index_type);
+      header.setClusterPtrPos(offset);
+      offset += data->clustersList.size() * sizeof(offset_type);
+      header.setChecksumPos(offset);
+
+      TINFO(" write header");
+      lseek(out_fd, 0, SEEK_SET);
+      header.write(out_fd);
+
       TINFO(" write mimetype list");
+      lseek(out_fd, header.getMimeListPos(), SEEK_SET);
       for(auto& mimeType: data->mimeTypesList)
       {
         _write(out_fd, mimeType.c_str(), mimeType.size()+1);
@@ -296,63 +457,64 @@ namespace zim
 
       ASSERT(lseek(out_fd, 0, SEEK_CUR), <, CLUSTER_BASE_OFFSET);
 
+      TINFO(" checksum clusters");
+      struct zim_MD5_CTX md5ctx;
+      zim_MD5Init(&md5ctx);
+      {
+        std::vector<char> batch_read(WRITE_BUFFER_SIZE);
+        lseek(out_fd, 0, SEEK_SET);
+        offset_type remaining = clustersEnd;
+        while (remaining) {
+          auto r = read(out_fd, batch_read.data(), std::min<offset_type>(remaining, batch_read.size()));
+          if (r == -1) {
+            perror("Cannot read");
+            throw std::runtime_error("oups");
+          }
+          if (r == 0)
+            throw std::runtime_error("Unexpected end of file");
+          zim_MD5Update(&md5ctx, reinterpret_cast<unsigned char*>(batch_read.data()), r);
+          remaining -= r;
+        }
+      }
+
+      // The rest of the file is written (and checksummed) through a buffer.
+      BufferedWriter writer(out_fd, &md5ctx);
+
       TINFO(" write directory entries");
-      lseek(out_fd, 0, SEEK_END);
       for (Dirent* dirent: data->dirents)
       {
-        dirent->setOffset(offset_t(lseek(out_fd, 0, SEEK_CUR)));
-        dirent->write(out_fd);
+        dirent->write([&](const Blob& blob) -> void {
+          writer.write(blob.data(), blob.size());
+        });
       }
 
       TINFO(" write url prt list");
-      header.setUrlPtrPos(lseek(out_fd, 0, SEEK_CUR));
       for (auto& dirent: data->dirents)
       {
         char tmp_buff[sizeof(offset_type)];
         toLittleEndian(dirent->getOffset(), tmp_buff);
-        _write(out_fd, tmp_buff, sizeof(offset_type));
+        writer.write(tmp_buff, sizeof(offset_type));
       }
 
       TINFO(" write title index");
-      header.setTitleIdxPos(lseek(out_fd, 0, SEEK_CUR));
       for (Dirent* dirent: data->titleIdx)
       {
         char tmp_buff[sizeof(article_index_type)];
         toLittleEndian(dirent->getIdx().v, tmp_buff);
-        _write(out_fd, tmp_buff, sizeof(article_index_type));
+        writer.write(tmp_buff, sizeof(article_index_type));
       }
 
       TINFO(" write cluster offset list");
-      header.setClusterPtrPos(lseek(out_fd, 0, SEEK_CUR));
       for (auto cluster : data->clustersList)
       {
         char tmp_buff[sizeof(offset_type)];
         toLittleEndian(cluster->getOffset(), tmp_buff);
-        _write(out_fd, tmp_buff, sizeof(offset_type));
+        writer.write(tmp_buff, sizeof(offset_type));
       }
-
-      header.setChecksumPos(lseek(out_fd, 0, SEEK_CUR));
-
-      TINFO(" write header");
-      lseek(out_fd, 0, SEEK_SET);
-      header.write(out_fd);
+      writer.flush();
+      ASSERT(offset_type(lseek(out_fd, 0, SEEK_CUR)), ==, header.getChecksumPos());
 
       TINFO(" write checksum");
-      struct zim_MD5_CTX md5ctx;
-      unsigned char batch_read[1024+1];
-      lseek(out_fd, 0, SEEK_SET);
-      zim_MD5Init(&md5ctx);
-      while (true) {
-         auto r = read(out_fd, batch_read, 1024);
-         if (r == -1) {
-           perror("Cannot read");
-           throw std::runtime_error("oups");
-         }
-         if (r == 0)
-           break;
-         batch_read[r] = 0;
-         zim_MD5Update(&md5ctx, batch_read, r);
-      }
       unsigned char digest[16];
       zim_MD5Final(digest, &md5ctx);
       _write(out_fd, reinterpret_cast<const char*>(digest), 16);
@@ -362,8 +524,12 @@ namespace zim
                                    bool verbose,
                                    bool withIndex,
                                    std::string language,
-                                   CompressionType c)
-      : compression(c),
+                                   CompressionType c,
+                                   bool streamingCompression)
+      : bytesInFlight(0),
+        queuedBytes(0),
+        compression(c),
+        streamingCompression(streamingCompression),
         withIndex(withIndex),
         indexingLanguage(language),
 #if defined(ENABLE_XAPIAN)
@@ -376,11 +542,33 @@ namespace zim
         nbUnCompArticles(0),
         nbFileArticles(0),
         nbIndexArticles(0),
+        nbDedupArticles(0),
+        dedupSize(0),
+        nbReusedArticles(0),
+        nbCopiedClusters(0),
+        articlesSize(0),
+        nbIndexedArticles(0),
+        nbWrittenClusters(0),
+        writtenSize(0),
+        compressionTime(0),
+        indexingTime(0),
+        writingTime(0),
         nbClusters(0),
         nbCompClusters(0),
         nbUnCompClusters(0),
+        rawCompClustersSize(0),
+        compClustersSize(0),
         start_time(time(NULL))
     {
+      pthread_mutex_init(&creatorLock, NULL);
+      pthread_mutex_init(&clusterQueueLock, NULL);
+      pthread_mutex_init(&memoryLock, NULL);
+      pthread_cond_init(&memoryFreed, NULL);
+      pthread_mutex_init(&statsLock, NULL);
+      pthread_mutex_init(&baseDigestsLock, NULL);
+      ratioHistogram.fill(0);
+      startTime = lastStatsReport = std::chrono::steady_clock::now();
+      clusteringStrategy = std::make_shared<ClusteringStrategy>();
       basename =  (fname.size() > 4 && fname.compare(fname.size() - 4, 4, ".zim") == 0)
                         ? fname.substr(0, fname.size() - 4)
                         : fname;
@@ -403,12 +591,10 @@ int mode =  _S_IREAD | _S_IWRITE;
         throw std::runtime_error("Impossible to seek in file");
       }
 
+      // Clusters are created when the first article of a group is added.
       // We keep both a "compressed cluster" and an "uncompressed cluster"
-      // because we don't know which one will fill up first.  We also need
-      // to track the dirents currently in each, so we can fix up the
-      // cluster index if the other one ends up written first.
-      compCluster = new Cluster(compression);
-      uncompCluster = new Cluster(zimcompNone);
+      // per group because we don't know which one will fill up first.
+      zstdDictPending = (compression == zimcompZstdDict);
 
 #if defined(ENABLE_XAPIAN)
       titleIndexer.indexingPrelude(basename+"_title.idx");
@@ -421,20 +607,249 @@ int mode =  _S_IREAD | _S_IWRITE;
 
     CreatorData::~CreatorData()
     {
-      if (compCluster)
-        delete compCluster;
-      if (uncompCluster)
-        delete uncompCluster;
+      pthread_mutex_destroy(&creatorLock);
+      pthread_mutex_destroy(&clusterQueueLock);
+      pthread_mutex_destroy(&memoryLock);
+      pthread_cond_destroy(&memoryFreed);
+      pthread_mutex_destroy(&statsLock);
+      pthread_mutex_destroy(&baseDigestsLock);
+      for(auto& openCluster: openClusters) {
+        delete openCluster.second.cluster;
+      }
       for(auto& cluster: clustersList) {
         delete cluster;
       }
+      for(auto& cluster: zstdDictPendingClusters) {
+        delete cluster;
+      }
 #if defined(ENABLE_XAPIAN)
       if (indexer)
         delete indexer;
 #endif
     }
 
-    void CreatorData::addDirent(Dirent* dirent, const Article* article)
+    void CreatorData::addArticle(const Article* article)
+    {
+      if (!article->isRedirect() && article->getFilename().empty()) {
+        waitForMemory(article->getSize());
+      }
+
+      // Read and hash the content before taking the lock, so producers can
+      // do it in parallel.
+      // Plain content is read only once, to hash it, to sample it for the
+      // zstd dictionary and to add it to the cluster.
+      Blob data;
+      bool dataRead = false;
+      std::string digest;
+      if ((deduplication || deltaBase) && !article->isRedirect() && article->getSize() > 0)
+      {
+        digest = contentDigest(article, &data, &dataRead);
+      }
+      if (zstdDictPending && !dataRead && !article->isRedirect()
+       && article->shouldCompress() && article->getFilename().empty()
+       && article->getSize() > 0)
+      {
+        data = article->getData();
+        dataRead = true;
+      }
+      BaseBlob baseBlob;
+      bool reused = deltaBase && !digest.empty() && findBaseBlob(article, digest, &baseBlob);
+      ContentKey contentKey;
+      if (!reused && deduplication && !digest.empty())
+      {
+        contentKey = ContentKey(article->getSize(), digest);
+      }
+
+      TitleIndexTask::Titles titles;
+      ClusterList closed;
+      bool train = false;
+      pthread_mutex_lock(&creatorLock);
+      auto dirent = createDirentFromArticle(article);
+      auto cluster = addDirent(dirent, article, contentKey, reused ? &baseBlob : nullptr);
+      if (cluster && dataRead && zstdDictPending && !zstdDictTraining
+       && article->shouldCompress()) {
+        addZstdDictSample(data);
+      }
+      updateStats(article);
+      auto& producer = producers[std::this_thread::get_id()];
+      producer.lastArticle = nbArticles;
+      if (cluster) {
+        // Keep the other producers from closing the cluster before the
+        // content is added.
+        producer.adding++;
+      }
+      if (nbArticles % IDLE_PRODUCER_ARTICLES == 0) {
+        closeIdleProducers();
+      }
+      if (zstdDictPending && !zstdDictTraining
+       && zstdDictSamples.size() >= ZSTD_DICT_SAMPLES_SIZE) {
+        zstdDictTraining = true;
+        train = true;
+      }
+#if defined(ENABLE_XAPIAN)
+      if (article->shouldIndex()) {
+        titlesToIndex.emplace_back(article->getUrl().getLongUrl(), article->getTitle());
+        if (titlesToIndex.size() >= TITLE_INDEX_BATCH_SIZE) {
+          titles.swap(titlesToIndex);
+        }
+      }
+#endif
+      closed.swap(closedClusters);
+      pthread_mutex_unlock(&creatorLock);
+
+      // Queuing may wait for the workers, do it without the lock.
+      queueClusters(closed);
+
+      // The cluster is only filled by this producer, the content can be
+      // added (and maybe compressed) without the lock.
+      if (cluster) {
+        auto memorySize = cluster->getMemorySize();
+        if (dataRead) {
+          cluster->addData(data.data(), zsize_t(data.size()));
+        } else {
+          cluster->addArticle(article);
+        }
+        bytesInFlight += int64_t(cluster->getMemorySize()) - int64_t(memorySize);
+        producer.adding--;
+      }
+
+      if (train) {
+        trainZstdDictionary();
+      }
+
+      if (!titles.empty()) {
+        taskList.pushToQueue(new TitleIndexTask(std::move(titles)));
+      }
+      reportStats(false);
+    }
+
+    void CreatorData::updateStats(const Article* article)
+    {
+      nbArticles++;
+      if (article->isRedirect()) {
+        nbRedirectArticles++;
+      } else {
+        if (article->shouldCompress())
+          nbCompArticles++;
+        else
+          nbUnCompArticles++;
+        if (!article->getFilename().empty())
+          nbFileArticles++;
+        if (article->shouldIndex())
+          nbIndexArticles++;
+        articlesSize += article->getSize();
+      }
+      if (verbose && nbArticles%1000 == 0) {
+        printStats();
+      }
+    }
+
+    void CreatorData::printStats()
+    {
+      double seconds = difftime(time(NULL), start_time);
+      std::cout << "T:" << (int)seconds
+                << "; A:" << nbArticles
+                << "; RA:" << nbRedirectArticles
+                << "; CA:" << nbCompArticles
+                << "; UA:" << nbUnCompArticles
+                << "; FA:" << nbFileArticles
+                << "; IA:" << nbIndexArticles
+                << "; DA:" << nbDedupArticles
+                << "; BA:" << nbReusedArticles
+                << "; C:" << nbClusters
+                << "; CC:" << nbCompClusters
+                << "; UC:" << nbUnCompClusters
+                << "; WC:" << taskList.size()
+                << "; M:" << bytesInFlight.load()
+                << std::endl;
+    }
+
+    CreatorStats CreatorData::getStats()
+    {
+      CreatorStats stats;
+      auto now = std::chrono::steady_clock::now();
+      // The generic operator- of zim_types.h hides the std::chrono one.
+      stats.elapsedTime = std::chrono::duration<double>(
+        std::chrono::operator-(now, startTime)).count();
+
+      stats.articles = nbArticles.load();
+      stats.redirectArticles = nbRedirectArticles.load();
+      stats.compressedArticles = nbCompArticles.load();
+      stats.uncompressedArticles = nbUnCompArticles.load();
+      stats.fileArticles = nbFileArticles.load();
+      stats.dedupArticles = nbDedupArticles.load();
+      stats.reusedArticles = nbReusedArticles.load();
+      stats.articlesSize = articlesSize.load();
+      stats.clusters = nbClusters.load();
+      stats.compressedClusters = nbCompClusters.load();
+      stats.uncompressedClusters = nbUnCompClusters.load();
+      stats.copiedClusters = nbCopiedClusters.load();
+      stats.indexArticles = nbIndexArticles.load();
+
+      pthread_mutex_lock(&statsLock);
+      stats.compressions = compressionStats;
+      stats.ratioHistogram = ratioHistogram;
+      pthread_mutex_unlock(&statsLock);
+
+      stats.writtenClusters = nbWrittenClusters.load();
+      stats.writtenSize = writtenSize.load();
+      stats.indexedArticles = nbIndexedArticles.load();
+      stats.compressionTime = compressionTime.load() / 1e6;
+      stats.writingTime = writingTime.load() / 1e6;
+      stats.indexingTime = indexingTime.load() / 1e6;
+
+      stats.waitingTasks = taskList.size();
+      stats.waitingClusters = clusterToWrite.size();
+      auto inFlight = bytesInFlight.load();
+      stats.bytesInFlight = inFlight > 0 ? inFlight : 0;
+
+      stats.workerThreads = workerThreads.size();
+      if (stats.workerThreads && stats.elapsedTime > 0) {
+        stats.workerUtilisation = (stats.compressionTime + stats.indexingTime)
+                                / (stats.elapsedTime * stats.workerThreads);
+      }
+      return stats;
+    }
+
+    void CreatorData::reportStats(bool force)
+    {
+      if (!statsCallback)
+        return;
+      auto now = std::chrono::steady_clock::now();
+      pthread_mutex_lock(&statsLock);
+      bool due = force || std::chrono::operator-(now, lastStatsReport) >= statsPeriod;
+      if (due)
+        lastStatsReport = now;
+      pthread_mutex_unlock(&statsLock);
+      if (due)
+        statsCallback(getStats());
+    }
+
+    void CreatorData::addWrittenCluster(const Cluster* cluster, zim::size_type size)
+    {
+      nbWrittenClusters++;
+      writtenSize += size;
+      if (cluster->getCompression() == zimcompNone || cluster->isCopied())
+        return;
+
+      compClustersSize += size;
+      auto rawSize = cluster->getDataSize().v;
+      pthread_mutex_lock(&statsLock);
+      auto& compressionStat = compressionStats[cluster->getCompression()];
+      compressionStat.clusters++;
+      compressionStat.rawSize += rawSize;
+      compressionStat.compressedSize += size;
+      unsigned bucket = 0;
+      while (bucket + 1 < ratioHistogram.size()
+          && rawSize >= (zim::size_type(2) << bucket) * size) {
+        bucket++;
+      }
+      ratioHistogram[bucket]++;
+      pthread_mutex_unlock(&statsLock);
+    }
+
+    Cluster* CreatorData::addDirent(Dirent* dirent, const Article* article,
+                                    const ContentKey& contentKey, const BaseBlob* baseBlob)
     {
       auto ret = dirents.insert(dirent);
       if (!ret.second) {
@@ -447,7 +862,7 @@ int mode =  _S_IREAD | _S_IWRITE;
           std::cerr << "Impossible to add " << dirent->getFullUrl().getLongUrl() << std::endl;
           std::cerr << "  dirent's title to add is : " << dirent->getTitle() << std::endl;
           std::cerr << "  existing dirent's title is : " << existing->getTitle() << std::endl;
-          return;
+          return nullptr;
         }
       };
 
@@ -455,7 +870,7 @@ int mode =  _S_IREAD | _S_IWRITE;
       if (dirent->isRedirect())
       {
         unresolvedRedirectDirents.insert(dirent);
-        return;
+        return nullptr;
       }
 
       // Add blob data to compressed or uncompressed cluster.
@@ -465,30 +880,241 @@ int mode =  _S_IREAD | _S_IWRITE;
         isEmpty = false;
       }
 
-      Cluster *cluster;
-      if (article->shouldCompress())
+      if (baseBlob)
       {
-        cluster = compCluster;
+        // The blob is added (or its base cluster copied) at the end.
+        auto& reused = reusedBlobs[*baseBlob];
+        if (reused.dirents.empty()) {
+          reused.compressed = article->shouldCompress();
+          reused.groupKey = clusteringStrategy->getGroupKey(article);
+        }
+        reused.dirents.push_back(dirent);
+        nbReusedArticles++;
+        return nullptr;
       }
-      else
+
+      if (!contentKey.second.empty())
       {
-        cluster = uncompCluster;
+        auto it = contentBlobs.find(contentKey);
+        if (it != contentBlobs.end()) {
+          dirent->setCluster(it->second.first, it->second.second);
+          nbDedupArticles++;
+          dedupSize += articleSize;
+          return nullptr;
+        }
       }
 
+      auto cluster = reserveBlob(dirent, article->shouldCompress(),
+                                 clusteringStrategy->getGroupKey(article),
+                                 articleSize);
+      if (!contentKey.second.empty()) {
+        contentBlobs[contentKey] = BlobLocation(cluster, dirent->getBlobNumber());
+      }
+      return cluster;
+    }
+
+    Cluster* CreatorData::reserveBlob(Dirent* dirent, bool compressed,
+                                      const std::string& groupKey, zim::size_type size)
+    {
+      auto key = OpenClusterKey(std::this_thread::get_id(), compressed, groupKey);
+      Cluster *cluster = getOpenCluster(key);
+
       // If cluster will be too large, write it to dis, and open a new
       // one for the content.
       if ( cluster->count()
-        && cluster->size().v+articleSize >= minChunkSize * 1024
+        && clusteringStrategy->isFull(cluster->size().v,
+                                      cluster->count().v,
+                                      size,
+                                      minChunkSize * 1024)
          )
       {
         log_info("cluster with " << cluster->count() << " articles, " <<
                  cluster->size() << " bytes; current title \"" <<
                  dirent->getTitle() << '\"');
-        cluster = closeCluster(article->shouldCompress());
+        closeCluster(cluster);
+        cluster = newCluster(compressed);
+        openClusters[key].cluster = cluster;
       }
 
+      // The blob is reserved now, the content is added by the caller.
       dirent->setCluster(cluster);
-      cluster->addArticle(article);
+      return cluster;
+    }
+
+    void CreatorData::setDeltaBase(std::shared_ptr<const File> base)
+    {
+      deltaBase = base;
+      std::vector<BaseBlob> blobs;
+      for (article_index_type i = 0; i < base->getCountArticles(); ++i) {
+        auto article = base->getArticle(i);
+        if (article.isRedirect() || article.isLinktarget() || article.isDeleted())
+          continue;
+        blobs.emplace_back(article.getClusterNumber(), article.getBlobNumber());
+      }
+      std::sort(blobs.begin(), blobs.end());
+      blobs.erase(std::unique(blobs.begin(), blobs.end()), blobs.end());
+      for (auto& blob: blobs) {
+        baseClusterBlobs[blob.first]++;
+      }
+    }
+
+    std::string CreatorData::baseBlobDigest(const BaseBlob& blob)
+    {
+      pthread_mutex_lock(&baseDigestsLock);
+      auto it = baseClusterDigests.find(blob.first);
+      if (it != baseClusterDigests.end()) {
+        auto digest = blob.second < it->second.size() ? it->second[blob.second] : std::string();
+        pthread_mutex_unlock(&baseDigestsLock);
+        return digest;
+      }
+      pthread_mutex_unlock(&baseDigestsLock);
+
+      // All the blobs of the base cluster are hashed at once, the cluster is
+      // uncompressed only for its first blob matching an article.
+      auto cluster = deltaBase->getCluster(blob.first);
+      std::vector<std::string> digests;
+      for (blob_index_type i = 0; i < cluster->count().v; ++i) {
+        auto data = cluster->getBlob(blob_index_t(i));
+        struct zim_MD5_CTX md5ctx;
+        zim_MD5Init(&md5ctx);
+        zim_MD5Update(&md5ctx, reinterpret_cast<const unsigned char*>(data.data()), data.size());
+        unsigned char digest[16];
+        zim_MD5Final(digest, &md5ctx);
+        digests.emplace_back(reinterpret_cast<char*>(digest), 16);
+      }
+      auto digest = blob.second < digests.size() ? digests[blob.second] : std::string();
+
+      pthread_mutex_lock(&baseDigestsLock);
+      baseClusterDigests.emplace(blob.first, std::move(digests));
+      pthread_mutex_unlock(&baseDigestsLock);
+      return digest;
+    }
+
+    bool CreatorData::findBaseBlob(const Article* article, const std::string& digest,
+                                   BaseBlob* baseBlob)
+    {
+      if (article->isRedirect() || article->isLinktarget() || article->isDeleted())
+        return false;
+      auto baseArticle = deltaBase->getArticleByUrl(article->getUrl().getLongUrl());
+      if (!baseArticle.good()
+       || baseArticle.isRedirect()
+       || baseArticle.isLinktarget()
+       || baseArticle.isDeleted())
+        return false;
+      // The size is read from the base cluster offsets and the content
+      // compared by its digest, without uncompressing the base cluster.
+      if (baseArticle.getArticleSize() != article->getSize())
+        return false;
+      BaseBlob blob(baseArticle.getClusterNumber(), baseArticle.getBlobNumber());
+      if (baseBlobDigest(blob) != digest)
+        return false;
+      *baseBlob = blob;
+      return true;
+    }
+
+    void CreatorData::addReusedBlobs()
+    {
+      auto it = reusedBlobs.begin();
+      while (it != reusedBlobs.end()) {
+        auto clusterIdx = it->first.first;
+        auto last = reusedBlobs.upper_bound(
+          BaseBlob(clusterIdx, std::numeric_limits<blob_index_type>::max()));
+
+        // A base cluster whose content is all reused is copied as it is,
+        // unless it needs the zstd dictionary of the base file.
+        Cluster* copy = nullptr;
+        std::shared_ptr<const zim::Cluster> baseCluster;
+        if (size_type(std::distance(it, last)) == baseClusterBlobs[clusterIdx]) {
+          auto raw = deltaBase->getRawCluster(clusterIdx);
+          if ((raw.data()[0] & 0x0F) != zimcompZstdDict) {
+            copy = new Cluster(zimcompNone);
+            copy->setRawCluster(raw);
+            bytesInFlight += copy->getMemorySize();
+          }
+        }
+
+        for (; it != last; ++it) {
+          auto blobIdx = it->first.second;
+          auto& reused = it->second;
+          if (copy) {
+            for (auto dirent: reused.dirents) {
+              dirent->setCluster(copy, blob_index_t(blobIdx));
+            }
+            continue;
+          }
+          if (!baseCluster) {
+            baseCluster = deltaBase->getCluster(clusterIdx);
+          }
+          auto blob = baseCluster->getBlob(blob_index_t(blobIdx));
+          auto first = reused.dirents.front();
+          auto cluster = reserveBlob(first, reused.compressed, reused.groupKey, blob.size());
+          for (auto dirent: reused.dirents) {
+            dirent->setCluster(cluster, first->getBlobNumber());
+          }
+          auto memorySize = cluster->getMemorySize();
+          cluster->addData(blob.data(), zsize_t(blob.size()));
+          bytesInFlight += int64_t(cluster->getMemorySize()) - int64_t(memorySize);
+        }
+
+        if (copy) {
+          nbClusters++;
+          nbCopiedClusters++;
+          queueCluster(copy);
+        }
+      }
+      reusedBlobs.clear();
+      queueClusters(closedClusters);
+    }
+
+    void CreatorData::addZstdDictSample(const Blob& data)
+    {
+      auto size = std::min<size_t>(data.size(), ZSTD_DICT_MAX_SAMPLE_SIZE);
+      zstdDictSamples.append(data.data(), size);
+      zstdDictSampleSizes.push_back(size);
+    }
+
+    void CreatorData::trainZstdDictionary()
+    {
+      // The training is long, the samples are taken out of the lock to train
+      // the dictionary without it.
+      std::string samples;
+      std::vector<size_t> sampleSizes;
+      pthread_mutex_lock(&creatorLock);
+      samples.swap(zstdDictSamples);
+      sampleSizes.swap(zstdDictSampleSizes);
+      pthread_mutex_unlock(&creatorLock);
+
+      auto dictionary = ZSTD_INFO::train_dictionary(samples, sampleSizes,
+                                                    ZSTD_DICT_MAX_SIZE);
+
+      pthread_mutex_lock(&creatorLock);
+      zstdDictPending = false;
+      zstdDictTraining = false;
+      zstdDictionary = dictionary;
+      if (zstdDictionary.empty()) {
+        // Not enough samples to train a dictionary, use plain zstd.
+        compression = zimcompZstd;
+      } else {
+        zstdCDict = ZSTD_INFO::create_cdict(zstdDictionary.data(), zstdDictionary.size(),
+                                            compressionOptions.level);
+      }
+
+      for (auto& openCluster: openClusters) {
+        if (std::get<1>(openCluster.first)) {
+          openCluster.second.cluster->setCompression(compression);
+          openCluster.second.cluster->setZstdDictionary(zstdCDict);
+        }
+      }
+      ClusterList closed;
+      for (auto cluster: zstdDictPendingClusters) {
+        cluster->setCompression(compression);
+        cluster->setZstdDictionary(zstdCDict);
+        closed.push_back(cluster);
+      }
+      ClusterList().swap(zstdDictPendingClusters);
+      pthread_mutex_unlock(&creatorLock);
+
+      queueClusters(closed);
     }
 
     Dirent* CreatorData::createDirentFromArticle(const Article* article)
@@ -522,32 +1148,214 @@ int mode =  _S_IREAD | _S_IWRITE;
       return dirent;
     }
 
-    Cluster* CreatorData::closeCluster(bool compressed)
+    Cluster* CreatorData::getOpenCluster(const OpenClusterKey& key)
     {
-      Cluster *cluster;
+      auto& openCluster = openClusters[key];
+      openCluster.lastUse = ++openClustersClock;
+      if (openCluster.cluster)
+        return openCluster.cluster;
+
+      // The clusters of a producer are together in the map.
+      auto producer = std::get<0>(key);
+      auto first = openClusters.lower_bound(OpenClusterKey(producer, false, std::string()));
+      size_t producerClusters = 0;
+      auto lru = openClusters.end();
+      for (auto it = first; it != openClusters.end() && std::get<0>(it->first) == producer; ++it) {
+        if (!it->second.cluster)
+          continue;
+        producerClusters++;
+        if (lru == openClusters.end() || it->second.lastUse < lru->second.lastUse)
+          lru = it;
+      }
+      if (producerClusters >= MAX_OPEN_CLUSTERS) {
+        // Too many groups, close the least recently used cluster.
+        closeCluster(lru->second.cluster);
+        openClusters.erase(lru);
+      }
+      openCluster.cluster = newCluster(std::get<1>(key));
+      return openCluster.cluster;
+    }
+
+    Cluster* CreatorData::newCluster(bool compressed)
+    {
+      if (!compressed)
+        return new Cluster(zimcompNone);
+      auto streaming = streamingCompression && !zstdDictPending
+                    && streamingClusters < MAX_STREAMING_CLUSTERS;
+      auto cluster = new Cluster(compression, streaming);
+      if (cluster->is_streaming())
+        streamingClusters++;
+      cluster->setZstdDictionary(zstdCDict);
+      cluster->setCompressionOptions(getCompressionOptions());
+      return cluster;
+    }
+
+    void CreatorData::setCompressionOptions(const CompressionOptions& options, bool adaptive)
+    {
+      compressionOptions = options;
+      adaptiveCompression = adaptive;
+      maxCompressionLevel = options.level < 0
+                          ? defaultCompressionLevel(compression)
+                          : options.level;
+      compressionLevel = maxCompressionLevel;
+    }
+
+    CompressionOptions CreatorData::getCompressionOptions() const
+    {
+      auto options = compressionOptions;
+      if (compressionLevel != maxCompressionLevel) {
+        options.level = compressionLevel;
+      }
+      return options;
+    }
+
+    void CreatorData::adaptCompressionLevel()
+    {
+      if (!adaptiveCompression)
+        return;
+      auto waitingTasks = taskList.size();
+      if (waitingTasks >= MAX_QUEUE_SIZE && compressionLevel > 1) {
+        compressionLevel--;
+      } else if (waitingTasks == 0 && compressionLevel < maxCompressionLevel) {
+        compressionLevel++;
+      }
+    }
+
+    void CreatorData::closeCluster(Cluster* cluster)
+    {
+      if (cluster->is_streaming())
+        streamingClusters--;
       nbClusters++;
-      if (compressed )
+      auto compressed = cluster->getCompression() != zimcompNone;
+      if (compressed)
       {
-        cluster = compCluster;
         nbCompClusters++;
+        rawCompClustersSize += cluster->size().v;
+        adaptCompressionLevel();
+        if (!cluster->is_streaming()) {
+          // The cluster is compressed from now, with the current level.
+          cluster->setCompressionOptions(getCompressionOptions());
+        }
       } else {
-        cluster = uncompCluster;
         nbUnCompClusters++;
       }
+
+      if (compressed && zstdDictPending) {
+        // The cluster will be compressed once the dictionary is trained.
+        zstdDictPendingClusters.push_back(cluster);
+      } else {
+        closedClusters.push_back(cluster);
+      }
+    }
+
+    void CreatorData::deleteEmptyCluster(Cluster* cluster)
+    {
+      if (cluster->is_streaming())
+        streamingClusters--;
+      delete cluster;
+    }
+
+    void CreatorData::closeOpenClusters()
+    {
+      for (auto& openCluster: openClusters) {
+        auto cluster = openCluster.second.cluster;
+        if (cluster->count()) {
+          closeCluster(cluster);
+        } else {
+          deleteEmptyCluster(cluster);
+        }
+      }
+      openClusters.clear();
+      producers.clear();
+      queueClusters(closedClusters);
+    }
+
+    void CreatorData::closeIdleProducers()
+    {
+      auto current = std::this_thread::get_id();
+      auto it = producers.begin();
+      while (it != producers.end()) {
+        if (it->first == current
+         || nbArticles - it->second.lastArticle < IDLE_PRODUCER_ARTICLES
+         || it->second.adding.load()) {
+          ++it;
+          continue;
+        }
+        auto first = openClusters.lower_bound(OpenClusterKey(it->first, false, std::string()));
+        auto last = first;
+        for (; last != openClusters.end() && std::get<0>(last->first) == it->first; ++last) {
+          auto cluster = last->second.cluster;
+          if (cluster && cluster->count()) {
+            closeCluster(cluster);
+          } else if (cluster) {
+            deleteEmptyCluster(cluster);
+          }
+        }
+        openClusters.erase(first, last);
+        it = producers.erase(it);
+      }
+    }
+
+    void CreatorData::setMaxBytesInFlight(zim::size_type bytes)
+    {
+      maxBytesInFlight = bytes;
+      clusterToWrite.setMaxSize(bytes ? 0 : MAX_QUEUE_SIZE);
+    }
+
+    void CreatorData::waitForMemory(zim::size_type size)
+    {
+      if (!maxBytesInFlight)
+        return;
+      // Only the memory of the queued clusters is freed without the
+      // producers: when there is none, go on, the open clusters have to be
+      // filled to be written. A cluster bigger than the budget goes alone.
+      pthread_mutex_lock(&memoryLock);
+      while (queuedBytes.load() > 0
+          && bytesInFlight.load() + int64_t(size) > int64_t(maxBytesInFlight)) {
+        pthread_cond_wait(&memoryFreed, &memoryLock);
+      }
+      pthread_mutex_unlock(&memoryLock);
+    }
+
+    void CreatorData::updateQueuedMemory(int64_t delta)
+    {
+      bytesInFlight += delta;
+      queuedBytes += delta;
+      if (delta < 0 && maxBytesInFlight) {
+        pthread_mutex_lock(&memoryLock);
+        pthread_cond_broadcast(&memoryFreed);
+        pthread_mutex_unlock(&memoryLock);
+      }
+    }
+
+    void CreatorData::queueCluster(Cluster* cluster)
+    {
+      // The memory of the cluster is already in bytesInFlight.
+      queuedBytes += cluster->getMemorySize();
+
+      pthread_mutex_lock(&clusterQueueLock);
       cluster->setClusterIndex(cluster_index_t(clustersList.size()));
       clustersList.push_back(cluster);
-      taskList.pushToQueue(new ClusterTask(cluster));
       clusterToWrite.pushToQueue(cluster);
-
       if (cluster->is_extended() )
         isExtended = true;
-      if (compressed)
-      {
-        cluster = compCluster = new Cluster(compression);
+      pthread_mutex_unlock(&clusterQueueLock);
+
+      // With a budget, the memory limits the number of clusters waiting to
+      // be compressed, not the size of the task queue.
+      if (maxBytesInFlight) {
+        taskList.forcePushToQueue(new ClusterTask(cluster));
       } else {
-        cluster = uncompCluster = new Cluster(zimcompNone);
+        taskList.pushToQueue(new ClusterTask(cluster));
       }
-      return cluster;
+    }
+
+    void CreatorData::queueClusters(ClusterList& clusters)
+    {
+      for (auto cluster: clusters) {
+        queueCluster(cluster);
+      }
+      clusters.clear();
     }
 
     void CreatorData::setArticleIndexes()
@@ -21,13 +21,21 @@
 #define ZIM_WRITER_CREATOR_DATA_H
 
 #include <zim/fileheader.h>
+#include <zim/file.h>
 #include <zim/writer/article.h>
+#include <zim/writer/clusteringStrategy.h>
+#include <zim/writer/creator.h>
 #include "queue.h"
 #include "_dirent.h"
 #include "workers.h"
 #include "xapianIndexer.h"
+#include <atomic>
+#include <chrono>
 #include <vector>
 #include <map>
+#include <memory>
+#include <thread>
+#include <tuple>
 #include <fstream>
 #include "config.h"
 
@@ -70,12 +78,74 @@ namespace zim
 
         CreatorData(const std::string& fname, bool verbose,
                        bool withIndex, std::string language,
-                       CompressionType compression);
+                       CompressionType compression,
+                       bool streamingCompression);
         virtual ~CreatorData();
 
-        void addDirent(Dirent* dirent, const Article* article);
+        // With deduplication, the blobs already added by (size, md5 digest)
+        // of their content.
+        typedef std::pair<zim::size_type, std::string> ContentKey;
+        typedef std::pair<Cluster*, blob_index_t> BlobLocation;
+
+        // The clusters being filled, by producer thread, compression and
+        // group key of the clustering strategy.
+        typedef std::tuple<std::thread::id, bool, std::string> OpenClusterKey;
+
+        // With a delta base, the blob of the base file (cluster and blob
+        // index) with the same content as an article.
+        typedef std::pair<cluster_index_type, blob_index_type> BaseBlob;
+        struct ReusedBlob {
+          std::vector<Dirent*> dirents;
+          bool compressed;
+          std::string groupKey;
+        };
+
+        // Can be called by several threads at the same time.
+        void addArticle(const Article* article);
+
+        Cluster* addDirent(Dirent* dirent, const Article* article,
+                           const ContentKey& contentKey, const BaseBlob* baseBlob);
+        Cluster* reserveBlob(Dirent* dirent, bool compressed,
+                             const std::string& groupKey, zim::size_type size);
         Dirent* createDirentFromArticle(const Article* article);
-        Cluster* closeCluster(bool compressed);
+        void updateStats(const Article* article);
+        void printStats();
+        CreatorStats getStats();
+        // Call the stats callback if its period is elapsed (or if force).
+        void reportStats(bool force);
+        void addWrittenCluster(const Cluster* cluster, zim::size_type writtenSize);
+        Cluster* getOpenCluster(const OpenClusterKey& key);
+        Cluster* newCluster(bool compressed);
+        // With creatorLock held: the cluster is put in closedClusters, to be
+        // queued once the lock is released.
+        void closeCluster(Cluster* cluster);
+        // With creatorLock held: delete an open cluster without content.
+        void deleteEmptyCluster(Cluster* cluster);
+        void closeOpenClusters();
+        void closeIdleProducers();
+        // Without creatorLock held.
+        void queueCluster(Cluster* cluster);
+        void queueClusters(ClusterList& clusters);
+        void setMaxBytesInFlight(zim::size_type bytes);
+        // With a budget, wait for the writer to free memory before adding
+        // size bytes to the clusters.
+        void waitForMemory(zim::size_type size);
+        // Called by the workers and the writer when the memory held by the
+        // queued clusters changes.
+        void updateQueuedMemory(int64_t delta);
+
+        void setCompressionOptions(const CompressionOptions& options, bool adaptive);
+        CompressionOptions getCompressionOptions() const;
+        void adaptCompressionLevel();
+
+        void setDeltaBase(std::shared_ptr<const File> base);
+        bool findBaseBlob(const Article* article, const std::string& digest, BaseBlob* baseBlob);
+        // The md5 digest of the content of a blob of the base file.
+        std::string baseBlobDigest(const BaseBlob& blob);
+        void addReusedBlobs();
+
+        void addZstdDictSample(const Blob& data);
+        void trainZstdDictionary();
 
         void setArticleIndexes();
         void resolveRedirectIndexes();
@@ -101,35 +171,128 @@ namespace zim
         ClusterList clustersList;
         ClusterQueue clusterToWrite;
         TaskQueue taskList;
+        // The memory held by the clusters not written yet: open, queued,
+        // raw and compressed. With a budget, producers wait in addArticle
+        // for it to go down, instead of waiting for a number of clusters.
+        std::atomic<int64_t> bytesInFlight;
+        // The part of bytesInFlight held by the queued clusters, freed by the
+        // workers and the writer without the help of the producers.
+        std::atomic<int64_t> queuedBytes;
+        zim::size_type maxBytesInFlight = 0;
+        pthread_mutex_t memoryLock;
+        pthread_cond_t memoryFreed;
         ThreadList workerThreads;
         pthread_t  writerThread;
-        const CompressionType compression;
+        CompressionType compression;
+        const bool streamingCompression;
+        CompressionOptions compressionOptions;
+        // With adaptive compression, the level of the compressed clusters
+        // goes down (to 1) when the compression workers cannot keep up and
+        // up (to maxCompressionLevel) when they are idle.
+        bool adaptiveCompression = false;
+        int compressionLevel = 0;
+        int maxCompressionLevel = 0;
         std::string basename;
         bool isEmpty = true;
         bool isExtended = false;
         zsize_t clustersSize;
-        Cluster *compCluster = nullptr;
-        Cluster *uncompCluster = nullptr;
         int out_fd;
 
+        // The content of the articles is added to the clusters outside of this
+        // lock, each producer thread having its own open clusters.
+        pthread_mutex_t creatorLock;
+        ClusterList closedClusters;
+        // Keep the clusters in the same order in clustersList and in
+        // clusterToWrite.
+        pthread_mutex_t clusterQueueLock;
+
+        struct OpenCluster {
+          Cluster* cluster = nullptr;
+          unsigned long lastUse = 0;
+        };
+        typedef std::map<OpenClusterKey, OpenCluster> OpenClusters;
+        OpenClusters openClusters;
+        unsigned long openClustersClock = 0;
+        // The number of open streaming clusters, each one holding an encoder.
+        unsigned streamingClusters = 0;
+        // The open clusters of a producer which has not added any article for
+        // a while are closed by the other producers, if it is not adding
+        // content to them.
+        struct Producer {
+          article_index_type lastArticle = 0;
+          std::atomic<unsigned> adding{0};
+        };
+        std::map<std::thread::id, Producer> producers;
+        std::shared_ptr<ClusteringStrategy> clusteringStrategy;
+
+        // With zimcompZstdDict, compressed clusters are kept aside until
+        // enough samples are collected to train the dictionary.
+        // Checked without creatorLock, the samples being read before taking it.
+        std::atomic<bool> zstdDictPending{false};
+        // The dictionary is trained by a producer, without creatorLock held.
+        bool zstdDictTraining = false;
+        std::string zstdDictSamples;
+        std::vector<size_t> zstdDictSampleSizes;
+        ClusterList zstdDictPendingClusters;
+        std::string zstdDictionary;
+        std::shared_ptr<const ZSTD_CDict> zstdCDict;
+
+        bool deduplication = false;
+        std::map<ContentKey, BlobLocation> contentBlobs;
+
+        std::shared_ptr<const File> deltaBase;
+        // The number of blobs referenced by the articles of each base cluster.
+        std::map<cluster_index_type, size_type> baseClusterBlobs;
+        // The md5 digests of the blobs of the base clusters, by cluster.
+        // A base cluster is hashed the first time one of its blobs is
+        // compared, by the producers, without creatorLock.
+        std::map<cluster_index_type, std::vector<std::string>> baseClusterDigests;
+        pthread_mutex_t baseDigestsLock;
+        std::map<BaseBlob, ReusedBlob> reusedBlobs;
+
         bool withIndex;
         std::string indexingLanguage;
 #if defined(ENABLE_XAPIAN)
         XapianIndexer titleIndexer;
+        // The titles waiting to be indexed by a TitleIndexTask.
+        TitleIndexTask::Titles titlesToIndex;
         XapianIndexer* indexer = nullptr;
 #endif
 
-        // Some stats
+        // Some stats, updated with creatorLock held but read without it
+        // by getStats.
         bool verbose;
-        article_index_type nbArticles;
-        article_index_type nbRedirectArticles;
-        article_index_type nbCompArticles;
-        article_index_type nbUnCompArticles;
-        article_index_type nbFileArticles;
-        article_index_type nbIndexArticles;
-        cluster_index_type nbClusters;
-        cluster_index_type nbCompClusters;
-        cluster_index_type nbUnCompClusters;
+        std::atomic<article_index_type> nbArticles;
+        std::atomic<article_index_type> nbRedirectArticles;
+        std::atomic<article_index_type> nbCompArticles;
+        std::atomic<article_index_type> nbUnCompArticles;
+        std::atomic<article_index_type> nbFileArticles;
+        std::atomic<article_index_type> nbIndexArticles;
+        std::atomic<article_index_type> nbDedupArticles;
+        std::atomic<zim::size_type> dedupSize;
+        std::atomic<article_index_type> nbReusedArticles;
+        std::atomic<cluster_index_type> nbCopiedClusters;
+        std::atomic<zim::size_type> articlesSize;
+        std::atomic<article_index_type> nbIndexedArticles;
+        std::atomic<cluster_index_type> nbWrittenClusters;
+        std::atomic<zim::size_type> writtenSize;
+        // In microseconds.
+        std::atomic<uint64_t> compressionTime;
+        std::atomic<uint64_t> indexingTime;
+        std::atomic<uint64_t> writingTime;
+        // Updated by the writer thread.
+        pthread_mutex_t statsLock;
+        std::map<CompressionType, CreatorStats::CompressionStats> compressionStats;
+        CreatorStats::RatioHistogram ratioHistogram;
+        Creator::StatsCallback statsCallback;
+        std::chrono::milliseconds statsPeriod;
+        std::chrono::steady_clock::time_point startTime;
+        std::chrono::steady_clock::time_point lastStatsReport;
+        std::atomic<cluster_index_type> nbClusters;
+        std::atomic<cluster_index_type> nbCompClusters;
+        std::atomic<cluster_index_type> nbUnCompClusters;
+        std::atomic<zim::size_type> rawCompClustersSize;
+        std::atomic<zim::size_type> compClustersSize;
         time_t start_time;
 
         cluster_index_t clusterCount() const
@@ -35,6 +35,13 @@
 log_define("zim.dirent")
 
 void zim::writer::Dirent::write(int out_fd) const
+{
+  write([=](const Blob& data) -> void {
+    _write(out_fd, data.data(), data.size());
+  });
+}
+
+void zim::writer::Dirent::write(writer_t writer) const
 {
   union
   {
@@ -52,26 +59,26 @@ void zim::writer::Dirent::write(int out_fd) const
   if (isRedirect())
   {
     zim::toLittleEndian(getRedirectIndex().v, header.d + 8);
-    _write(out_fd, header.d, 12);
+    writer(Blob(header.d, 12));
   }
   else if (isLinktarget() || isDeleted())
   {
-    _write(out_fd, header.d, 8);
+    writer(Blob(header.d, 8));
   }
   else
   {
     zim::toLittleEndian(zim::cluster_index_type(getClusterNumber()), header.d + 8);
     zim::toLittleEndian(zim::blob_index_type(getBlobNumber()), header.d + 12);
-    _write(out_fd, header.d, 16);
+    writer(Blob(header.d, 16));
   }
 
   auto& url = getUrl();
-  _write(out_fd, url.c_str(), url.size()+1);
+  writer(Blob(url.c_str(), url.size()+1));
 
   std::string t = getTitle();
   if (t != getUrl())
-    _write(out_fd, t.c_str(), t.size());
+    writer(Blob(t.c_str(), t.size()));
   char c = 0;
-  _write(out_fd, &c, 1);
+  writer(Blob(&c, 1));
 
 }
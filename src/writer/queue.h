@@ -29,17 +29,24 @@
 template<typename T>
 class Queue {
     public:
-        Queue() {pthread_mutex_init(&m_queueMutex,NULL);};
+        // A maxSize of 0 means no limit.
+        explicit Queue(size_t maxSize = MAX_QUEUE_SIZE)
+          : m_maxSize(maxSize)
+        {pthread_mutex_init(&m_queueMutex,NULL);};
         virtual ~Queue() {pthread_mutex_destroy(&m_queueMutex);};
+        void setMaxSize(size_t maxSize);
         virtual bool isEmpty();
         virtual size_t size();
         virtual void pushToQueue(const T& element);
+        // Push even if the queue is full.
+        virtual void forcePushToQueue(const T& element);
         virtual bool getHead(T &element);
         virtual bool popFromQueue(T &element);
 
     protected:
         std::queue<T>   m_realQueue;
         pthread_mutex_t m_queueMutex;
+        size_t          m_maxSize;
 
     private:
         // Make this queue non copyable
@@ -47,6 +54,13 @@ class Queue {
         Queue& operator=(const Queue&);
 };
 
+template<typename T>
+void Queue<T>::setMaxSize(size_t maxSize) {
+    pthread_mutex_lock(&m_queueMutex);
+    m_maxSize = maxSize;
+    pthread_mutex_unlock(&m_queueMutex);
+}
+
 template<typename T>
 bool Queue<T>::isEmpty() {
     pthread_mutex_lock(&m_queueMutex);
@@ -66,21 +80,28 @@ size_t Queue<T>::size() {
 template<typename T>
 void Queue<T>::pushToQueue(const T &element) {
     unsigned int wait = 0;
-    unsigned int queueSize = 0;
+    bool full = false;
 
     do {
         zim::microsleep(wait);
         pthread_mutex_lock(&m_queueMutex);
-        queueSize = m_realQueue.size();
+        full = m_maxSize && m_realQueue.size() > m_maxSize;
         pthread_mutex_unlock(&m_queueMutex);
         wait += 10;
-    } while (queueSize > MAX_QUEUE_SIZE);
+    } while (full);
 
     pthread_mutex_lock(&m_queueMutex);
     m_realQueue.push(element);
     pthread_mutex_unlock(&m_queueMutex);
 }
 
+template<typename T>
+void Queue<T>::forcePushToQueue(const T &element) {
+    pthread_mutex_lock(&m_queueMutex);
+    m_realQueue.push(element);
+    pthread_mutex_unlock(&m_queueMutex);
+}
+
 template<typename T>
 bool Queue<T>::getHead(T &element) {
   pthread_mutex_lock(&m_queueMutex);
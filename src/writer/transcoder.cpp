@@ -0,0 +1,343 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include <zim/writer/transcoder.h>
+#include <zim/file.h>
+#include <zim/error.h>
+
+#include "cluster.h"
+#include "../cluster.h"
+#include "../fileimpl.h"
+#include "../endian_tools.h"
+#include "../md5.h"
+#include "../fs.h"
+#include "../log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <ctime>
+
+#ifdef _WIN32
+# include <io.h>
+#else
+# include <unistd.h>
+# define _write(fd, addr, size) if(::write((fd), (addr), (size)) != (ssize_t)(size)) \
+{throw std::runtime_error("Error writing");}
+#endif
+
+log_define("zim.writer.transcoder")
+
+// Number of clusters each worker thread can recompress ahead of the writer.
+#define CLUSTERS_AHEAD_PER_WORKER 2
+
+#define READ_BUFFER_SIZE (4*1024*1024)
+
+namespace zim
+{
+  namespace writer
+  {
+    namespace
+    {
+
+    struct TranscodeJob
+    {
+      FileImpl* source;
+      CompressionType compression;
+      CompressionOptions compressionOptions;
+      cluster_index_type clusterCount;
+      cluster_index_type window;
+
+      std::atomic<cluster_index_type> nextCluster;
+      // The recompressed clusters not written yet, by index.
+      std::vector<std::unique_ptr<Cluster>> clusters;
+      cluster_index_type written = 0;
+      std::exception_ptr error;
+      pthread_mutex_t lock;
+      pthread_cond_t cond;
+
+      TranscodeJob() : nextCluster(0)
+      {
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&cond, NULL);
+      }
+      ~TranscodeJob()
+      {
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&lock);
+      }
+    };
+
+    std::unique_ptr<Cluster> transcodeCluster(TranscodeJob* job, cluster_index_type idx)
+    {
+      auto sourceCluster = job->source->getCluster(cluster_index_t(idx));
+      std::unique_ptr<Cluster> cluster;
+      if (!sourceCluster->isCompressed()) {
+        cluster.reset(new Cluster(zimcompNone));
+        cluster->setRawCluster(job->source->getRawCluster(cluster_index_t(idx)));
+        return cluster;
+      }
+
+      cluster.reset(new Cluster(job->compression));
+      cluster->setCompressionOptions(job->compressionOptions);
+      for (blob_index_type i = 0; i < sourceCluster->count().v; ++i) {
+        auto blob = sourceCluster->getBlob(blob_index_t(i));
+        cluster->addData(blob.data(), zsize_t(blob.size()));
+      }
+      cluster->close();
+      return cluster;
+    }
+
+    void* transcodeWorker(void* arg)
+    {
+      auto job = static_cast<TranscodeJob*>(arg);
+      while (true) {
+        auto idx = job->nextCluster++;
+        if (idx >= job->clusterCount)
+          return nullptr;
+
+        // Do not go too far ahead of the writer, to bound the memory used.
+        pthread_mutex_lock(&job->lock);
+        while (idx >= job->written + job->window && !job->error) {
+          pthread_cond_wait(&job->cond, &job->lock);
+        }
+        bool stop = bool(job->error);
+        pthread_mutex_unlock(&job->lock);
+        if (stop)
+          return nullptr;
+
+        std::unique_ptr<Cluster> cluster;
+        std::exception_ptr error;
+        try {
+          cluster = transcodeCluster(job, idx);
+        } catch (...) {
+          error = std::current_exception();
+        }
+
+        pthread_mutex_lock(&job->lock);
+        if (error) {
+          if (!job->error)
+            job->error = error;
+        } else {
+          job->clusters[idx] = std::move(cluster);
+        }
+        pthread_cond_broadcast(&job->cond);
+        pthread_mutex_unlock(&job->lock);
+      }
+    }
+
+    void writeChecksummed(int out_fd, struct zim_MD5_CTX* md5ctx, const char* data, size_t size)
+    {
+      zim_MD5Update(md5ctx, reinterpret_cast<const unsigned char*>(data), size);
+      _write(out_fd, data, size);
+    }
+
+    } // namespace
+
+    void Transcoder::transcode(const File& source, const std::string& fname) const
+    {
+      if (compression == zimcompZstdDict) {
+        throw std::runtime_error("The transcoder cannot train a zstd dictionary");
+      }
+      auto start_time = time(NULL);
+      auto impl = source.impl;
+      auto sourceHeader = impl->getFileheader();
+      auto articleCount = sourceHeader.getArticleCount();
+      auto clusterCount = sourceHeader.getClusterCount();
+
+      // The directory entries do not depend on the cluster offsets, they are
+      // copied as a whole.
+      std::vector<offset_type> direntOffsets(articleCount);
+      offset_type direntsStart = 0;
+      offset_type direntsEnd = 0;
+      if (articleCount) {
+        auto urlPtrs = impl->getRawData(offset_t(sourceHeader.getUrlPtrPos()),
+                                        zsize_t(articleCount * sizeof(offset_type)));
+        for (article_index_type i = 0; i < articleCount; ++i) {
+          direntOffsets[i] = fromLittleEndian<offset_type>(urlPtrs.data() + i * sizeof(offset_type));
+        }
+        direntsStart = *std::min_element(direntOffsets.begin(), direntOffsets.end());
+        direntsEnd = impl->getPartEnd(offset_t(direntsStart)).v;
+        for (auto offset: direntOffsets) {
+          if (offset >= direntsEnd)
+            throw ZimFileFormatError("Directory entries are not stored together");
+        }
+      }
+      auto mimeListEnd = impl->getPartEnd(offset_t(sourceHeader.getMimeListPos())).v;
+
+      auto tmp_name = fname + ".tmp";
+#ifdef _WIN32
+      int mode =  _S_IREAD | _S_IWRITE;
+#else
+      mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+#endif
+      int out_fd = open(tmp_name.c_str(), O_RDWR|O_CREAT|O_TRUNC, mode);
+      if (out_fd == -1) {
+        perror(nullptr);
+        throw std::runtime_error("Cannot create file " + tmp_name);
+      }
+
+      Fileheader header = sourceHeader;
+      header.setMimeListPos(Fileheader::size);
+      lseek(out_fd, Fileheader::size, SEEK_SET);
+      {
+        auto mimeList = impl->getRawData(offset_t(sourceHeader.getMimeListPos()),
+                                         zsize_t(mimeListEnd - sourceHeader.getMimeListPos()));
+        _write(out_fd, mimeList.data(), mimeList.size());
+      }
+
+      TranscodeJob job;
+      job.source = impl.get();
+      job.compression = compression;
+      job.compressionOptions = compressionOptions;
+      job.clusterCount = clusterCount;
+      auto nbThreads = nbWorkerThreads ? nbWorkerThreads : 1;
+      job.window = CLUSTERS_AHEAD_PER_WORKER * nbThreads;
+      job.clusters.resize(clusterCount);
+
+      std::vector<pthread_t> workerThreads;
+      for (unsigned i = 0; i < nbThreads; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, transcodeWorker, &job) == 0)
+          workerThreads.push_back(thread);
+      }
+
+      // Write the clusters in order, as they are recompressed.
+      std::vector<offset_type> clusterOffsets(clusterCount);
+      std::exception_ptr error;
+      for (cluster_index_type idx = 0; idx < clusterCount; ++idx) {
+        if (workerThreads.empty()) {
+          // No worker could be started, recompress the cluster here.
+          try {
+            job.clusters[idx] = transcodeCluster(&job, idx);
+          } catch (...) {
+            job.error = std::current_exception();
+          }
+        }
+        pthread_mutex_lock(&job.lock);
+        while (!job.clusters[idx] && !job.error) {
+          pthread_cond_wait(&job.cond, &job.lock);
+        }
+        std::unique_ptr<Cluster> cluster = std::move(job.clusters[idx]);
+        error = job.error;
+        pthread_mutex_unlock(&job.lock);
+        if (error)
+          break;
+
+        try {
+          clusterOffsets[idx] = lseek(out_fd, 0, SEEK_CUR);
+          cluster->write(out_fd);
+        } catch (...) {
+          error = std::current_exception();
+        }
+        if (cluster->is_extended()) {
+          header.setMajorVersion(Fileheader::zimExtendedMajorVersion);
+        }
+
+        pthread_mutex_lock(&job.lock);
+        if (error && !job.error)
+          job.error = error;
+        job.written = idx + 1;
+        pthread_cond_broadcast(&job.cond);
+        pthread_mutex_unlock(&job.lock);
+        if (error)
+          break;
+
+        if (verbose && (idx+1)%1000 == 0) {
+          std::cout << "T:" << (int)difftime(time(NULL), start_time)
+                    << "; C:" << idx+1 << "/" << clusterCount << std::endl;
+        }
+      }
+      for (auto& thread: workerThreads) {
+        pthread_join(thread, nullptr);
+      }
+      if (error) {
+        ::close(out_fd);
+        DEFAULTFS::removeFile(tmp_name);
+        std::rethrow_exception(error);
+      }
+
+      // All sizes are known, compute the layout of the end of the file.
+      offset_type clustersEnd = lseek(out_fd, 0, SEEK_CUR);
+      offset_type newDirentsStart = clustersEnd;
+      header.setUrlPtrPos(newDirentsStart + direntsEnd - direntsStart);
+      header.setTitleIdxPos(header.getUrlPtrPos() + articleCount * sizeof(offset_type));
+      header.setClusterPtrPos(header.getTitleIdxPos() + articleCount * sizeof(article_index_type));
+      header.setChecksumPos(header.getClusterPtrPos() + clusterCount * sizeof(offset_type));
+
+      lseek(out_fd, 0, SEEK_SET);
+      header.write(out_fd);
+
+      struct zim_MD5_CTX md5ctx;
+      zim_MD5Init(&md5ctx);
+      {
+        std::vector<char> batch_read(READ_BUFFER_SIZE);
+        lseek(out_fd, 0, SEEK_SET);
+        offset_type remaining = clustersEnd;
+        while (remaining) {
+          auto r = read(out_fd, batch_read.data(), std::min<offset_type>(remaining, batch_read.size()));
+          if (r <= 0) {
+            ::close(out_fd);
+            DEFAULTFS::removeFile(tmp_name);
+            throw std::runtime_error("Cannot read back " + tmp_name);
+          }
+          zim_MD5Update(&md5ctx, reinterpret_cast<unsigned char*>(batch_read.data()), r);
+          remaining -= r;
+        }
+      }
+
+      if (articleCount) {
+        auto dirents = impl->getRawData(offset_t(direntsStart), zsize_t(direntsEnd - direntsStart));
+        writeChecksummed(out_fd, &md5ctx, dirents.data(), dirents.size());
+
+        std::vector<char> urlPtrs(articleCount * sizeof(offset_type));
+        for (article_index_type i = 0; i < articleCount; ++i) {
+          toLittleEndian(direntOffsets[i] - direntsStart + newDirentsStart,
+                         urlPtrs.data() + i * sizeof(offset_type));
+        }
+        writeChecksummed(out_fd, &md5ctx, urlPtrs.data(), urlPtrs.size());
+
+        auto titleIdx = impl->getRawData(offset_t(sourceHeader.getTitleIdxPos()),
+                                         zsize_t(articleCount * sizeof(article_index_type)));
+        writeChecksummed(out_fd, &md5ctx, titleIdx.data(), titleIdx.size());
+      }
+
+      std::vector<char> clusterPtrs(clusterCount * sizeof(offset_type));
+      for (cluster_index_type i = 0; i < clusterCount; ++i) {
+        toLittleEndian(clusterOffsets[i], clusterPtrs.data() + i * sizeof(offset_type));
+      }
+      writeChecksummed(out_fd, &md5ctx, clusterPtrs.data(), clusterPtrs.size());
+
+      unsigned char digest[16];
+      zim_MD5Final(digest, &md5ctx);
+      _write(out_fd, reinterpret_cast<const char*>(digest), 16);
+      ::close(out_fd);
+
+      DEFAULTFS::rename(tmp_name, fname);
+      log_info("transcoded " << clusterCount << " clusters in "
+               << difftime(time(NULL), start_time) << "s");
+    }
+  }
+}
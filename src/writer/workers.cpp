@@ -25,6 +25,7 @@
 #include <zim/blob.h>
 #include "../endian_tools.h"
 #include <algorithm>
+#include <chrono>
 #include <fstream>
 
 #if defined(ENABLE_XAPIAN)
@@ -45,9 +46,9 @@
 #include "../fs.h"
 #include "../tools.h"
 
-static pthread_mutex_t s_dbaccessLock = PTHREAD_MUTEX_INITIALIZER;
 std::atomic<unsigned long> zim::writer::ClusterTask::waiting_task(0);
 std::atomic<unsigned long> zim::writer::IndexTask::waiting_task(0);
+std::atomic<unsigned long> zim::writer::TitleIndexTask::waiting_task(0);
 
 namespace zim
 {
@@ -76,23 +77,37 @@ namespace zim
     }
 
 
+    namespace {
+    // Add the time spent in a scope to a total (in microseconds).
+    class StageTimer {
+      public:
+        explicit StageTimer(std::atomic<uint64_t>& total)
+          : total(total),
+            start(std::chrono::steady_clock::now())
+        {}
+        ~StageTimer() {
+          total += std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::operator-(std::chrono::steady_clock::now(), start)).count();
+        }
+
+      private:
+        std::atomic<uint64_t>& total;
+        std::chrono::steady_clock::time_point start;
+    };
+    }
+
     void ClusterTask::run(CreatorData* data) {
+      StageTimer timer(data->compressionTime);
+      auto rawSize = cluster->getMemorySize();
       cluster->close();
+      // The raw content is replaced by the compressed one, charged until the
+      // writer has written it.
+      data->updateQueuedMemory(int64_t(cluster->getClosedMemorySize()) - int64_t(rawSize));
     };
 
     void IndexTask::run(CreatorData* data) {
-      Xapian::Stem stemmer;
-      Xapian::TermGenerator indexer;
-      try {
-        stemmer = Xapian::Stem(data->indexer->stemmer_language);
-        indexer.set_stemmer(stemmer);
-        indexer.set_stemming_strategy(Xapian::TermGenerator::STEM_ALL);
-      } catch (...) {
-        // No stemming for language.
-      }
-      indexer.set_stopper(&data->indexer->stopper);
-      indexer.set_stopper_strategy(Xapian::TermGenerator::STOP_ALL);
-
+      StageTimer timer(data->indexingTime);
+      data->nbIndexedArticles++;
       zim::MyHtmlParser htmlParser;
       try {
         htmlParser.parse_html(p_article->getData(), "UTF-8", true);
@@ -102,6 +117,9 @@ namespace zim
         return;
       }
 
+      // Each worker writes in its own shard of the index.
+      XapianShardGuard shard(*data->indexer);
+      auto& indexer = shard->termGenerator;
       Xapian::Document document;
       document.set_data(p_article->getUrl().getLongUrl());
       indexer.set_document(document);
@@ -139,9 +157,15 @@ namespace zim
         indexer.index_text_without_positions(content);
       }
 
-      pthread_mutex_lock(&s_dbaccessLock);
-      data->indexer->writableDatabase.add_document(document);
-      pthread_mutex_unlock(&s_dbaccessLock);
+      shard->database.add_document(document);
+    }
+
+    void TitleIndexTask::run(CreatorData* data) {
+      StageTimer timer(data->indexingTime);
+      XapianShardGuard shard(data->titleIndexer);
+      for (auto& title: titles) {
+        data->titleIndexer.indexTitle(shard.get(), title.first, title.second);
+      }
     }
 
     void* taskRunner(void* arg) {
@@ -180,9 +204,15 @@ namespace zim
             continue;
           }
           creatorData->clusterToWrite.popFromQueue(cluster);
-          cluster->setOffset(offset_t(lseek(creatorData->out_fd, 0, SEEK_CUR)));
-          cluster->write(creatorData->out_fd);
+          {
+            StageTimer timer(creatorData->writingTime);
+            auto offset = lseek(creatorData->out_fd, 0, SEEK_CUR);
+            cluster->setOffset(offset_t(offset));
+            cluster->write(creatorData->out_fd);
+            creatorData->addWrittenCluster(cluster, lseek(creatorData->out_fd, 0, SEEK_CUR) - offset);
+          }
           cluster->clear_data();
+          creatorData->updateQueuedMemory(-int64_t(cluster->getClosedMemorySize()));
           wait = 0;
         }
       }
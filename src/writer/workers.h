@@ -21,6 +21,10 @@
 #define OPENZIM_LIBZIM_WORKER_H
 
 #include <atomic>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace zim {
 namespace writer {
@@ -74,6 +78,28 @@ class IndexTask : public Task {
     std::shared_ptr<Article> p_article;
 };
 
+class TitleIndexTask : public Task {
+  public:
+    // The long url and the title of the articles to index.
+    typedef std::vector<std::pair<std::string, std::string>> Titles;
+
+    TitleIndexTask(Titles&& titles) :
+      titles(std::move(titles))
+    {
+      ++waiting_task;
+    }
+    virtual ~TitleIndexTask()
+    {
+      --waiting_task;
+    }
+
+    virtual void run(CreatorData* data);
+    static std::atomic<unsigned long> waiting_task;
+
+  private:
+    Titles titles;
+};
+
 void* taskRunner(void* data);
 void* clusterWriter(void* data);
 
@@ -44,6 +44,7 @@ XapianIndexer::XapianIndexer(const std::string& language, IndexingMode indexingM
   while (std::getline(file, stopWord, '\n')) {
     this->stopper.add(stopWord);
   }
+  pthread_mutex_init(&shardsLock, NULL);
 }
 
 XapianIndexer::~XapianIndexer()
@@ -52,32 +53,85 @@ XapianIndexer::~XapianIndexer()
     try {
 #ifndef _WIN32
 //[TODO] Implement remove for windows
-      zim::DEFAULTFS::remove(indexPath + ".tmp");
+      for (auto shard: shards) {
+        zim::DEFAULTFS::remove(shard->path);
+      }
       zim::DEFAULTFS::remove(indexPath);
 #endif
     } catch (...) {
       /* Do not raise */
     }
   }
+  for (auto shard: shards) {
+    delete shard;
+  }
+  pthread_mutex_destroy(&shardsLock);
 }
 
 void XapianIndexer::indexingPrelude(const string indexPath_)
 {
   indexPath = indexPath_;
-  writableDatabase = Xapian::WritableDatabase(indexPath + ".tmp", Xapian::DB_CREATE_OR_OVERWRITE);
+  // Always create a shard, to have a (maybe empty) database at the end.
+  freeShards.push_back(createShard());
+}
+
+XapianShard* XapianIndexer::createShard()
+{
+  auto shard = new XapianShard();
+  std::ostringstream path;
+  path << indexPath << ".tmp." << shards.size();
+  shard->path = path.str();
+  shards.push_back(shard);
+
+  auto& database = shard->database;
+  database = Xapian::WritableDatabase(shard->path, Xapian::DB_CREATE_OR_OVERWRITE);
   switch (indexingMode) {
     case IndexingMode::TITLE:
-      writableDatabase.set_metadata("valuesmap", "title:0");
-      writableDatabase.set_metadata("kind", "title");
+      database.set_metadata("valuesmap", "title:0");
+      database.set_metadata("kind", "title");
       break;
     case IndexingMode::FULL:
-      writableDatabase.set_metadata("valuesmap", "title:0;wordcount:1;geo.position:2");
-      writableDatabase.set_metadata("kind", "fulltext");
+      database.set_metadata("valuesmap", "title:0;wordcount:1;geo.position:2");
+      database.set_metadata("kind", "fulltext");
       break;
   }
-  writableDatabase.set_metadata("language", language);
-  writableDatabase.set_metadata("stopwords", stopwords);
-  writableDatabase.begin_transaction(true);
+  database.set_metadata("language", language);
+  database.set_metadata("stopwords", stopwords);
+  database.begin_transaction(true);
+
+  auto& termGenerator = shard->termGenerator;
+  try {
+    termGenerator.set_stemmer(Xapian::Stem(stemmer_language));
+    termGenerator.set_stemming_strategy(
+      indexingMode == IndexingMode::TITLE ? Xapian::TermGenerator::STEM_SOME
+                                          : Xapian::TermGenerator::STEM_ALL);
+  } catch (...) {
+    // No stemming for language.
+  }
+  termGenerator.set_stopper(&stopper);
+  termGenerator.set_stopper_strategy(Xapian::TermGenerator::STOP_ALL);
+  return shard;
+}
+
+XapianShard* XapianIndexer::acquireShard()
+{
+  pthread_mutex_lock(&shardsLock);
+  XapianShard* shard;
+  if (freeShards.empty()) {
+    shard = createShard();
+  } else {
+    shard = freeShards.back();
+    freeShards.pop_back();
+  }
+  pthread_mutex_unlock(&shardsLock);
+  return shard;
+}
+
+void XapianIndexer::releaseShard(XapianShard* shard)
+{
+  pthread_mutex_lock(&shardsLock);
+  freeShards.push_back(shard);
+  pthread_mutex_unlock(&shardsLock);
 }
 
 void XapianIndexer::index(const zim::writer::Article* article)
@@ -99,21 +153,18 @@ void XapianIndexer::indexFull(const zim::writer::Article* article)
 
 void XapianIndexer::indexTitle(const zim::writer::Article* article)
 {
-  Xapian::Stem stemmer;
-  Xapian::TermGenerator indexer;
-  try {
-    stemmer = Xapian::Stem(stemmer_language);
-    indexer.set_stemmer(stemmer);
-    indexer.set_stemming_strategy(Xapian::TermGenerator::STEM_SOME);
-  } catch (...) {}
-  indexer.set_stopper(&stopper);
-  indexer.set_stopper_strategy(Xapian::TermGenerator::STOP_ALL);
+  XapianShardGuard shard(*this);
+  indexTitle(shard.get(), article->getUrl().getLongUrl(), article->getTitle());
+}
+
+void XapianIndexer::indexTitle(XapianShard* shard, const std::string& longUrl, const std::string& accentedTitle)
+{
+  auto& indexer = shard->termGenerator;
   Xapian::Document currentDocument;
   currentDocument.clear_values();
-  currentDocument.set_data(article->getUrl().getLongUrl());
+  currentDocument.set_data(longUrl);
   indexer.set_document(currentDocument);
 
-  std::string accentedTitle = article->getTitle();
   std::string title = zim::removeAccents(accentedTitle);
 
   currentDocument.add_value(0, accentedTitle);
@@ -123,22 +174,22 @@ void XapianIndexer::indexTitle(const zim::writer::Article* article)
   }
 
   /* add to the database */
-  writableDatabase.add_document(currentDocument);
-}
-
-void XapianIndexer::flush()
-{
-  this->writableDatabase.commit_transaction();
-  this->writableDatabase.begin_transaction(true);
+  shard->database.add_document(currentDocument);
 }
 
+/* Must be called when no shard is used anymore. */
 void XapianIndexer::indexingPostlude()
 {
-  this->flush();
-  this->writableDatabase.commit_transaction();
-  this->writableDatabase.commit();
-  this->writableDatabase.compact(indexPath, Xapian::DBCOMPACT_SINGLE_FILE);
-  this->writableDatabase.close();
+  Xapian::Database database;
+  for (auto shard: shards) {
+    shard->database.commit_transaction();
+    shard->database.commit();
+    database.add_database(shard->database);
+  }
+  database.compact(indexPath, Xapian::DBCOMPACT_SINGLE_FILE);
+  for (auto shard: shards) {
+    shard->database.close();
+  }
 }
 
 XapianMetaArticle* XapianIndexer::getMetaArticle()
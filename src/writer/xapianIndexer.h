@@ -25,6 +25,8 @@
 
 #include <unicode/locid.h>
 #include <xapian.h>
+#include <pthread.h>
+#include <vector>
 #include <zim/blob.h>
 #include "xapian/myhtmlparse.h"
 
@@ -80,6 +82,16 @@ class XapianMetaArticle : public zim::writer::Article
   virtual std::string getFilename() const;
 };
 
+/* A part of the index, written by one thread at a time.
+ * The shards are merged at the end of the indexing.
+ */
+struct XapianShard
+{
+  std::string path;
+  Xapian::WritableDatabase database;
+  Xapian::TermGenerator termGenerator;
+};
+
 class XapianIndexer
 {
  public:
@@ -88,15 +100,25 @@ class XapianIndexer
   std::string getIndexPath() { return indexPath; }
   void indexingPrelude(const string indexPath);
   void index(const zim::writer::Article* article);
-  void flush();
   void indexingPostlude();
   XapianMetaArticle* getMetaArticle();
 
+  /* Get a shard not used by another thread, creating a new one if needed.
+   * The shard must be given back with releaseShard.
+   */
+  XapianShard* acquireShard();
+  void releaseShard(XapianShard* shard);
+
+  void indexTitle(XapianShard* shard, const std::string& longUrl, const std::string& title);
+
  protected:
   void indexTitle(const zim::writer::Article* article);
   void indexFull(const zim::writer::Article* article);
+  XapianShard* createShard();
 
-  Xapian::WritableDatabase writableDatabase;
+  std::vector<XapianShard*> shards;
+  std::vector<XapianShard*> freeShards;
+  pthread_mutex_t shardsLock;
   std::string stemmer_language;
   Xapian::SimpleStopper stopper;
   std::string indexPath;
@@ -107,4 +129,24 @@ class XapianIndexer
  friend class zim::writer::IndexTask;
 };
 
+/* Hold a shard of an indexer for the current scope. */
+class XapianShardGuard
+{
+ public:
+  explicit XapianShardGuard(XapianIndexer& indexer)
+    : indexer(indexer),
+      shard(indexer.acquireShard())
+  {}
+  ~XapianShardGuard() { indexer.releaseShard(shard); }
+  XapianShardGuard(const XapianShardGuard&) = delete;
+  XapianShardGuard& operator=(const XapianShardGuard&) = delete;
+
+  XapianShard* operator->() const { return shard; }
+  XapianShard* get() const { return shard; }
+
+ private:
+  XapianIndexer& indexer;
+  XapianShard* shard;
+};
+
 #endif  // LIBZIM_WRITER_XAPIANINDEXER_H
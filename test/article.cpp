@@ -0,0 +1,146 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include <zim/entry.h>
+#include <zim/file.h>
+#include <zim/writer/creator.h>
+
+#include "testzim.h"
+
+namespace
+{
+
+using namespace zim::unittests;
+
+class LayoutCreator : public zim::writer::Creator
+{
+  public:
+    LayoutCreator() : zim::writer::Creator(false, zim::zimcompZstd) {}
+    zim::writer::Url getLayoutUrl() const { return zim::writer::Url('A', "layout"); }
+};
+
+TEST(ArticleTest, entry)
+{
+  TempZimFile zimFile("test_article");
+  zim::writer::Creator creator(false, zim::zimcompZstd);
+  auto content = createZim(creator, zimFile.path);
+
+  zim::File file(zimFile.path);
+  for (auto& item: content) {
+    auto article = file.getArticleByUrl(item.first);
+    auto entry = article.getEntry();
+    ASSERT_TRUE(entry.good());
+    ASSERT_EQ(entry.getIndex(), article.getIndex());
+    ASSERT_EQ(entry.getUrl(), article.getUrl());
+    ASSERT_EQ(entry.getTitle(), article.getTitle());
+    ASSERT_EQ(entry.getLongUrl(), item.first);
+    ASSERT_EQ(entry.getMimeType(), item.second.first);
+    ASSERT_FALSE(entry.isRedirect());
+    ASSERT_EQ(entry.getClusterNumber(), article.getClusterNumber());
+    ASSERT_EQ(entry.getBlobNumber(), article.getBlobNumber());
+    ASSERT_EQ(entry.getArticleSize(), item.second.second.size());
+    ASSERT_EQ(std::string(entry.getData()), item.second.second);
+    ASSERT_EQ(std::string(entry.getData(1, 4)), item.second.second.substr(1, 4));
+  }
+
+  // A pinned cluster is not looked up in the cluster cache anymore.
+  auto entry = file.getArticleByUrl(content.begin()->first).getEntry();
+  entry.pinCluster();
+  auto hits = file.getClusterCacheHits();
+  auto misses = file.getClusterCacheMisses();
+  for (auto i = 0; i < 3; ++i) {
+    ASSERT_EQ(std::string(entry.getData()), content.begin()->second.second);
+    ASSERT_EQ(entry.getArticleSize(), content.begin()->second.second.size());
+  }
+  ASSERT_EQ(file.getClusterCacheHits(), hits);
+  ASSERT_EQ(file.getClusterCacheMisses(), misses);
+
+  ASSERT_FALSE(zim::Entry().good());
+  ASSERT_FALSE(file.getArticleByUrl("A/missing").getEntry().good());
+}
+
+TEST(ArticleTest, layoutPage)
+{
+  TempZimFile zimFile("test_article");
+  LayoutCreator creator;
+  creator.startZimCreation(zimFile.path);
+  creator.addArticle(std::make_shared<TestArticle>('A', "layout", "text/html",
+    "<html><%title%>|<%namespace%>|<%content%>|<%/A/footer%>|<%unknown%></html>"));
+  creator.addArticle(std::make_shared<TestArticle>('A', "footer", "text/plain", "F"));
+  creator.addArticle(std::make_shared<TestArticle>('A', "page", "text/html", "Hello"));
+  creator.addArticle(std::make_shared<TestArticle>('A', "template", zim::MimeHtmlTemplate,
+    "T:<%title%>|<%/A/footer%>"));
+  creator.addArticle(std::make_shared<TestArticle>('A', "broken", zim::MimeHtmlTemplate,
+    "<%/A/missing%>"));
+  creator.finishZimCreation();
+
+  zim::File file(zimFile.path);
+  auto page = file.getArticleByUrl("A/page");
+  // The second rendering uses the compiled layout.
+  for (auto i = 0; i < 2; ++i) {
+    ASSERT_EQ(page.getPage(), "<html>page|A|Hello|F|<%unknown%></html>");
+  }
+  ASSERT_EQ(page.getPage(false), "Hello");
+  auto tmpl = file.getArticleByUrl("A/template");
+  ASSERT_EQ(tmpl.getPage(false), "T:template|F");
+  ASSERT_THROW(file.getArticleByUrl("A/broken").getPage(false), std::runtime_error);
+  ASSERT_THROW(page.getPage(true, 0), std::runtime_error);
+}
+
+TEST(ArticleTest, pageSegments)
+{
+  TempZimFile zimFile("test_article");
+  LayoutCreator creator;
+  creator.startZimCreation(zimFile.path);
+  creator.addArticle(std::make_shared<TestArticle>('A', "layout", "text/html",
+    "<html><%title%>|<%content%>|<%/A/footer%></html>"));
+  creator.addArticle(std::make_shared<TestArticle>('A', "footer", "text/plain", "F", false));
+  creator.addArticle(std::make_shared<TestArticle>('A', "page", "text/html", "Hello", false));
+  creator.finishZimCreation();
+
+  std::vector<zim::Blob> segments;
+  {
+    zim::File file(zimFile.path);
+    auto page = file.getArticleByUrl("A/page");
+    segments = page.getPageSegments();
+    ASSERT_EQ(segments.size(), 7U);
+    ASSERT_EQ(std::string(segments[3]), "Hello");
+    std::string concatenated;
+    for (auto& segment: segments)
+      concatenated += std::string(segment);
+    ASSERT_EQ(concatenated, page.getPage());
+
+    segments = page.getPageSegments(false);
+    ASSERT_EQ(segments.size(), 1U);
+    ASSERT_EQ(std::string(segments[0]), "Hello");
+    segments = page.getPageSegments();
+  }
+  // The segments keep their buffers alive.
+  std::string concatenated;
+  for (auto& segment: segments)
+    concatenated += std::string(segment);
+  ASSERT_EQ(concatenated, "<html>page|Hello|F</html>");
+}
+
+}  // namespace
@@ -53,6 +53,7 @@
 #include "../src/file_reader.h"
 #include "../src/writer/cluster.h"
 #include "../src/endian_tools.h"
+#include "../src/compression.h"
 #include "../src/config.h"
 
 #include "tempfile.h"
@@ -238,6 +239,105 @@ TEST(ClusterTest, read_write_clusterZstd)
   ASSERT_TRUE(std::equal(b.data(), b.end(), blob2.data()));
 }
 
+TEST(ClusterTest, read_write_clusterZstdDict)
+{
+  std::string samples;
+  std::vector<size_t> sampleSizes;
+  for (int i=0; i<1000; i++) {
+    std::ostringstream ss;
+    ss << "<p>Paragraph " << i << " of the sample " << i*i << "</p>";
+    samples += ss.str();
+    sampleSizes.push_back(ss.str().size());
+  }
+  auto dict = ZSTD_INFO::train_dictionary(samples, sampleSizes, 1024);
+  ASSERT_FALSE(dict.empty());
+
+  zim::writer::Cluster cluster(zim::zimcompZstdDict);
+  cluster.setZstdDictionary(ZSTD_INFO::create_cdict(dict.data(), dict.size()));
+
+  std::string blob0("<p>Paragraph 1 of the sample 2</p>");
+  std::string blob1("ABCDEFGHIJKLMNOPQRSTUVWXYZ");
+  std::string blob2("<p>Paragraph 3 of the sample 4</p>");
+
+  cluster.addData(blob0.data(), zim::zsize_t(blob0.size()));
+  cluster.addData(blob1.data(), zim::zsize_t(blob1.size()));
+  cluster.addData(blob2.data(), zim::zsize_t(blob2.size()));
+
+  auto buffer = write_to_buffer(cluster);
+  zim::CompressionType comp;
+  bool extended;
+  ASSERT_THROW(zim::BufferReader(buffer).sub_clusterReader(zim::offset_t(0), &comp, &extended),
+               zim::ZimFileFormatError);
+
+  auto ddict = ZSTD_INFO::create_ddict(dict.data(), dict.size());
+  auto reader = std::shared_ptr<const zim::Reader>(zim::BufferReader(buffer).sub_clusterReader(zim::offset_t(0), &comp, &extended, ddict.get()));
+  ASSERT_EQ(comp, zim::zimcompZstdDict);
+  ASSERT_EQ(extended, false);
+  zim::Cluster cluster2(reader, comp, extended);
+  ASSERT_EQ(cluster2.count().v, 3U);
+  auto b = cluster2.getBlob(zim::blob_index_t(0));
+  ASSERT_TRUE(std::equal(b.data(), b.end(), blob0.data()));
+  b = cluster2.getBlob(zim::blob_index_t(1));
+  ASSERT_TRUE(std::equal(b.data(), b.end(), blob1.data()));
+  b = cluster2.getBlob(zim::blob_index_t(2));
+  ASSERT_TRUE(std::equal(b.data(), b.end(), blob2.data()));
+}
+
+TEST(ClusterTest, read_write_streamed_cluster)
+{
+  std::vector<zim::CompressionType> compressions{zim::zimcompLzma, zim::zimcompZstd};
+#if defined(ENABLE_ZLIB)
+  compressions.push_back(zim::zimcompZip);
+#endif
+  for (auto compression: compressions) {
+    zim::writer::Cluster cluster(compression, true);
+    ASSERT_TRUE(cluster.is_streaming());
+
+    std::vector<std::string> blobs;
+    for (auto i=0; i<50; i++) {
+      std::ostringstream ss;
+      for (auto j=0; j<i*20; j++) {
+        ss << "blob" << i << "-" << j*j << ";";
+      }
+      blobs.push_back(ss.str());
+      cluster.addData(blobs.back().data(), zim::zsize_t(blobs.back().size()));
+    }
+
+    auto buffer = write_to_buffer(cluster);
+    ASSERT_EQ(buffer->data(zim::offset_t(0))[0] & 0x20, 0x20);
+    zim::CompressionType comp;
+    bool extended;
+    auto reader = std::shared_ptr<const zim::Reader>(zim::BufferReader(buffer).sub_clusterReader(zim::offset_t(0), &comp, &extended));
+    ASSERT_EQ(comp, compression);
+    ASSERT_EQ(extended, false);
+    zim::Cluster cluster2(reader, comp, extended);
+    ASSERT_EQ(cluster2.count().v, blobs.size());
+    for (auto i=0U; i<blobs.size(); i++) {
+      ASSERT_EQ(cluster2.getBlobSize(zim::blob_index_t(i)).v, blobs[i].size());
+      auto b = cluster2.getBlob(zim::blob_index_t(i));
+      ASSERT_TRUE(std::equal(b.data(), b.end(), blobs[i].data()));
+    }
+  }
+}
+
+TEST(ClusterTest, streaming_uncompressed_cluster)
+{
+  zim::writer::Cluster cluster(zim::zimcompNone, true);
+  ASSERT_FALSE(cluster.is_streaming());
+}
+
+TEST(ClusterTest, streamed_cluster_memory)
+{
+  zim::writer::Cluster cluster(zim::zimcompZstd, true);
+  ASSERT_EQ(cluster.getMemorySize(), 0U);
+  std::string blob(1000, 'a');
+  cluster.addData(blob.data(), zim::zsize_t(blob.size()));
+  // The encoder and its output buffer are held until the close.
+  ASSERT_GT(cluster.getMemorySize(), 1024U*1024U);
+  cluster.close();
+  ASSERT_LT(cluster.getClosedMemorySize(), 1024U);
+}
+
 #if !defined(__APPLE__)
 TEST(ClusterTest, read_write_extended_cluster)
 {
@@ -19,6 +19,7 @@
 
 #include <algorithm>
 #include <memory>
+#include <sstream>
 #include "gtest/gtest.h"
 
 #include <zim/zim.h>
@@ -103,5 +104,83 @@ TYPED_TEST(CompressionTest, compress) {
   }
 }
 
+TYPED_TEST(CompressionTest, compressionOptions) {
+  std::string data;
+  for (int i=0; i<100000; i++) {
+    data.append(1, (char)((i*i)%251));
+  }
+
+  zim::CompressionOptions fastOptions;
+  fastOptions.level = 1;
+  zim::CompressionOptions windowOptions;
+  windowOptions.level = 3;
+  windowOptions.windowLog = 12;
+  windowOptions.longDistanceMatching = true;
+  windowOptions.nbWorkers = 2;
+  for (auto& options: {zim::CompressionOptions(), fastOptions, windowOptions}) {
+    typename TestFixture::CompressorT compressor;
+    compressor.init(nullptr, options);
+    compressor.feed(data.data(), data.size());
+    zim::zsize_t comp_size;
+    auto comp_data = compressor.get_data(&comp_size);
+
+    typename TestFixture::DecompressorT decompressor;
+    decompressor.init(comp_data.get());
+    ASSERT_EQ(decompressor.feed(comp_data.get(), comp_size.v), RunnerStatus::OK);
+    zim::zsize_t decomp_size;
+    auto decomp_data = decompressor.get_data(&decomp_size);
+    ASSERT_EQ(data, std::string(decomp_data.get(), decomp_size.v));
+  }
+}
+
+TEST(ZstdDictionaryTest, compress) {
+  std::string samples;
+  std::vector<size_t> sampleSizes;
+  for (int i=0; i<2000; i++) {
+    std::ostringstream ss;
+    ss << "<html><head><title>Article " << i << "</title></head>"
+       << "<body><h1>Article " << i*7 << "</h1><p>Some content "
+       << i*i << " in article " << i%13 << ".</p></body></html>";
+    samples += ss.str();
+    sampleSizes.push_back(ss.str().size());
+  }
+  auto dict = ZSTD_INFO::train_dictionary(samples, sampleSizes, 4*1024);
+  ASSERT_FALSE(dict.empty());
+  ASSERT_LE(dict.size(), 4*1024U);
+  auto cdict = ZSTD_INFO::create_cdict(dict.data(), dict.size());
+  auto ddict = ZSTD_INFO::create_ddict(dict.data(), dict.size());
+
+  const std::string data(samples, 0, sampleSizes[0]+sampleSizes[1]);
+  zim::Compressor<ZSTD_INFO> compressor;
+  compressor.init(nullptr, cdict.get());
+  compressor.feed(data.data(), data.size());
+  zim::zsize_t comp_size;
+  auto comp_data = compressor.get_data(&comp_size);
+
+  zim::Compressor<ZSTD_INFO> plainCompressor;
+  plainCompressor.init(nullptr);
+  plainCompressor.feed(data.data(), data.size());
+  zim::zsize_t plain_size;
+  plainCompressor.get_data(&plain_size);
+  ASSERT_LT(comp_size.v, plain_size.v);
+
+  zim::Uncompressor<ZSTD_INFO> decompressor;
+  decompressor.init(comp_data.get(), ddict.get());
+  ASSERT_EQ(decompressor.feed(comp_data.get(), comp_size.v), RunnerStatus::OK);
+  zim::zsize_t decomp_size;
+  auto decomp_data = decompressor.get_data(&decomp_size);
+  ASSERT_EQ(data, std::string(decomp_data.get(), decomp_size.v));
+
+  // Without dictionary, data cannot be uncompressed.
+  zim::Uncompressor<ZSTD_INFO> badDecompressor;
+  badDecompressor.init(comp_data.get());
+  ASSERT_EQ(badDecompressor.feed(comp_data.get(), comp_size.v), RunnerStatus::ERROR);
+}
+
+TEST(ZstdDictionaryTest, notEnoughSamples) {
+  std::string samples("abcdef");
+  std::vector<size_t> sampleSizes{3, 3};
+  ASSERT_TRUE(ZSTD_INFO::train_dictionary(samples, sampleSizes, 4*1024).empty());
+}
 
 }  // namespace
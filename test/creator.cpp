@@ -0,0 +1,430 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+#include <zim/file.h>
+#include <zim/writer/creator.h>
+#include <zim/writer/clusteringStrategy.h>
+#include <zim/writer/transcoder.h>
+
+#include "testzim.h"
+
+namespace
+{
+
+using namespace zim::unittests;
+
+TEST(CreatorTest, createZim)
+{
+  TempZimFile zimFile("test_creator");
+  zim::writer::Creator creator(false, zim::zimcompZstd);
+  auto content = createZim(creator, zimFile.path);
+
+  zim::File file(zimFile.path);
+  ASSERT_TRUE(file.verify());
+  checkContent(file, content);
+}
+
+TEST(CreatorTest, mimetypeClusteringStrategy)
+{
+  TempZimFile zimFile("test_creator");
+  zim::writer::Creator creator(false, zim::zimcompZstd);
+  creator.setClusteringStrategy(std::make_shared<zim::writer::MimetypeClusteringStrategy>());
+  auto content = createZim(creator, zimFile.path);
+
+  zim::File file(zimFile.path);
+  checkContent(file, content);
+  std::map<zim::cluster_index_type, std::set<std::string>> clusterMimetypes;
+  for (auto& entry: content) {
+    auto article = file.getArticleByUrl(entry.first);
+    clusterMimetypes[article.getClusterNumber()].insert(article.getMimeType());
+  }
+  ASSERT_GT(clusterMimetypes.size(), 2U);
+  for (auto& mimetypes: clusterMimetypes) {
+    ASSERT_EQ(mimetypes.second.size(), 1U);
+  }
+}
+
+TEST(CreatorTest, urlPrefixClusteringStrategy)
+{
+  TestArticle article('A', "section1/sub/article", "text/html", "");
+  ASSERT_EQ(zim::writer::UrlPrefixClusteringStrategy(0).getGroupKey(&article), "A/");
+  ASSERT_EQ(zim::writer::UrlPrefixClusteringStrategy(1).getGroupKey(&article), "A/section1/");
+  ASSERT_EQ(zim::writer::UrlPrefixClusteringStrategy(2).getGroupKey(&article), "A/section1/sub/");
+  ASSERT_EQ(zim::writer::UrlPrefixClusteringStrategy(3).getGroupKey(&article), "A/section1/sub/");
+
+  TempZimFile zimFile("test_creator");
+  zim::writer::Creator creator(false, zim::zimcompZstd);
+  creator.setClusteringStrategy(std::make_shared<zim::writer::UrlPrefixClusteringStrategy>());
+  auto content = createZim(creator, zimFile.path);
+
+  zim::File file(zimFile.path);
+  checkContent(file, content);
+  std::map<zim::cluster_index_type, std::set<std::string>> clusterSections;
+  for (auto& entry: content) {
+    auto article = file.getArticleByUrl(entry.first);
+    clusterSections[article.getClusterNumber()].insert(entry.first.substr(0, 10));
+  }
+  for (auto& sections: clusterSections) {
+    ASSERT_EQ(sections.second.size(), 1U);
+  }
+}
+
+TEST(CreatorTest, sizeClusteringStrategy)
+{
+  zim::writer::SizeClusteringStrategy strategy(1000, 10);
+  ASSERT_FALSE(strategy.isFull(500, 9, 100, 10));
+  ASSERT_TRUE(strategy.isFull(500, 10, 100, 10));
+  ASSERT_TRUE(strategy.isFull(900, 2, 100, 1000000));
+
+  TempZimFile zimFile("test_creator");
+  zim::writer::Creator creator(false, zim::zimcompZstd);
+  creator.setClusteringStrategy(std::make_shared<zim::writer::SizeClusteringStrategy>(1024*1024, 10));
+  auto content = createZim(creator, zimFile.path);
+
+  zim::File file(zimFile.path);
+  checkContent(file, content);
+  std::map<zim::cluster_index_type, unsigned> clusterCounts;
+  for (auto& entry: content) {
+    clusterCounts[file.getArticleByUrl(entry.first).getClusterNumber()]++;
+  }
+  for (auto& count: clusterCounts) {
+    ASSERT_LE(count.second, 10U);
+  }
+}
+
+TEST(CreatorTest, deduplication)
+{
+  TempZimFile zimFile("test_creator");
+  zim::writer::Creator creator(false, zim::zimcompZstd);
+  creator.setDeduplication(true);
+  creator.setMinChunkSize(4);
+  creator.startZimCreation(zimFile.path);
+  Content content;
+  for (auto i=0; i<100; i++) {
+    std::ostringstream url, data;
+    url << "article" << i;
+    data << "<html><body>Content " << i%10 << "</body></html>";
+    content["A/"+url.str()] = std::make_pair("text/html", data.str());
+    creator.addArticle(std::make_shared<TestArticle>('A', url.str(), "text/html", data.str(), i%2));
+  }
+  creator.finishZimCreation();
+
+  zim::File file(zimFile.path);
+  ASSERT_TRUE(file.verify());
+  checkContent(file, content);
+  // Articles sharing a blob get their data from the same (cached) cluster
+  // buffer.
+  std::set<const char*> blobs;
+  for (auto& entry: content) {
+    blobs.insert(file.getArticleByUrl(entry.first).getData().data());
+  }
+  ASSERT_EQ(blobs.size(), 10U);
+}
+
+TEST(CreatorTest, compressionOptions)
+{
+  zim::CompressionOptions options;
+  options.level = 5;
+  options.windowLog = 20;
+  for (auto compression: {zim::zimcompLzma, zim::zimcompZstd}) {
+    for (auto adaptive: {false, true}) {
+      TempZimFile zimFile("test_creator");
+      zim::writer::Creator creator(false, compression);
+      creator.setCompressionOptions(options, adaptive);
+      auto content = createZim(creator, zimFile.path);
+
+      zim::File file(zimFile.path);
+      ASSERT_TRUE(file.verify());
+      checkContent(file, content);
+    }
+  }
+}
+
+TEST(CreatorTest, concurrentProducers)
+{
+  for (auto streaming: {false, true}) {
+    TempZimFile zimFile("test_creator");
+    zim::writer::Creator creator(false, zim::zimcompZstd);
+    creator.setMinChunkSize(4);
+    creator.setDeduplication(true);
+    creator.setStreamingCompression(streaming);
+    creator.setClusteringStrategy(std::make_shared<zim::writer::MimetypeClusteringStrategy>());
+    // Each producer has its own streaming compressors, keep them small.
+    zim::CompressionOptions options;
+    options.level = 3;
+    creator.setCompressionOptions(options);
+    creator.startZimCreation(zimFile.path);
+    const auto nbProducers = 4;
+    std::vector<Content> contents(nbProducers);
+    std::vector<std::thread> producers;
+    for (auto p=0; p<nbProducers; p++) {
+      producers.emplace_back([p, &creator, &contents]() {
+        for (auto i=0; i<100; i++) {
+          std::ostringstream url, data;
+          url << "producer" << p << "/article" << i;
+          data << "<html><body>Content " << i%25 << " ";
+          for (auto j=0; j<i; j++) {
+            data << j << " ";
+          }
+          data << "</body></html>";
+          auto mimetype = (i%3) ? "text/html" : "text/css";
+          contents[p]["A/"+url.str()] = std::make_pair(mimetype, data.str());
+          creator.addArticle(std::make_shared<TestArticle>('A', url.str(), mimetype, data.str(), i%5));
+        }
+      });
+    }
+    for (auto& producer: producers) {
+      producer.join();
+    }
+    creator.finishZimCreation();
+
+    zim::File file(zimFile.path);
+    ASSERT_TRUE(file.verify());
+    for (auto& content: contents) {
+      checkContent(file, content);
+    }
+  }
+}
+
+TEST(CreatorTest, idleProducers)
+{
+  TempZimFile zimFile("test_creator");
+  zim::writer::Creator creator(false, zim::zimcompZstd);
+  creator.startZimCreation(zimFile.path);
+  Content content;
+  auto addArticles = [&](const std::string& prefix, int count) {
+    for (auto i=0; i<count; i++) {
+      std::ostringstream url, data;
+      url << prefix << "/article" << i;
+      data << "Content " << i;
+      content["A/"+url.str()] = std::make_pair("text/plain", data.str());
+      creator.addArticle(std::make_shared<TestArticle>('A', url.str(), "text/plain", data.str()));
+    }
+  };
+  std::thread(addArticles, "short", 10).join();
+  ASSERT_EQ(creator.getStats().clusters, 0U);
+  // The clusters of the finished thread are closed before the end.
+  addArticles("main", 9000);
+  ASSERT_EQ(creator.getStats().clusters, 1U);
+  creator.finishZimCreation();
+
+  zim::File file(zimFile.path);
+  ASSERT_TRUE(file.verify());
+  checkContent(file, content);
+}
+
+TEST(CreatorTest, fileArticles)
+{
+  std::vector<std::unique_ptr<TempFile>> files;
+  TempZimFile zimFile("test_creator");
+  zim::writer::Creator creator(false, zim::zimcompZstd);
+  creator.setMinChunkSize(4);
+  creator.startZimCreation(zimFile.path);
+  Content content;
+  for (auto i=0; i<20; i++) {
+    std::ostringstream url, data;
+    url << "file" << i;
+    for (auto j=0; j<i*100; j++) {
+      data << j << " ";
+    }
+    files.emplace_back(new TempFile("test_creator_file"));
+    auto& file = files.back();
+    ASSERT_EQ(write(file->fd(), data.str().data(), data.str().size()), ssize_t(data.str().size()));
+    content["A/"+url.str()] = std::make_pair("text/plain", data.str());
+    creator.addArticle(std::make_shared<TestFileArticle>('A', url.str(), "text/plain",
+                                                         data.str(), file->path(), i%2));
+  }
+  creator.finishZimCreation();
+
+  zim::File file(zimFile.path);
+  ASSERT_TRUE(file.verify());
+  checkContent(file, content);
+}
+
+TEST(CreatorTest, maxBytesInFlight)
+{
+  // A budget smaller than a cluster lets the clusters go one by one.
+  for (zim::size_type budget: {1, 16*1024}) {
+    TempZimFile zimFile("test_creator");
+    zim::writer::Creator creator(false, zim::zimcompZstd);
+    creator.setMaxBytesInFlight(budget);
+    zim::size_type maxBytesInFlight = 0;
+    creator.setStatsCallback([&](const zim::writer::CreatorStats& stats) {
+      maxBytesInFlight = std::max(maxBytesInFlight, stats.bytesInFlight);
+    }, std::chrono::milliseconds(0));
+    auto content = createZim(creator, zimFile.path);
+    // The open clusters (at most 8KiB here) are counted too.
+    ASSERT_GT(maxBytesInFlight, 0U);
+    ASSERT_LE(maxBytesInFlight, std::max<zim::size_type>(budget, 8*1024));
+    ASSERT_EQ(creator.getStats().bytesInFlight, 0U);
+
+    zim::File file(zimFile.path);
+    ASSERT_TRUE(file.verify());
+    checkContent(file, content);
+  }
+}
+
+TEST(CreatorTest, deltaBase)
+{
+  TempZimFile baseZimFile("test_creator");
+  {
+    zim::writer::Creator creator(false, zim::zimcompZstd);
+    createZim(creator, baseZimFile.path);
+  }
+  zim::File base(baseZimFile.path);
+  base.setClusterCacheMaxSize(1);
+
+  TempZimFile zimFile("test_creator");
+  zim::writer::Creator creator(false, zim::zimcompZstd);
+  auto baseClusterMisses = base.getClusterCacheMisses();
+  creator.setDeltaBase(base);
+  creator.setMinChunkSize(4);
+  creator.startZimCreation(zimFile.path);
+  // The base clusters are uncompressed when an article is compared with one
+  // of their blobs, and only once: the digests of their blobs are kept.
+  ASSERT_EQ(base.getClusterCacheMisses(), baseClusterMisses);
+  Content content;
+  for (auto i=0; i<210; i++) {
+    if (i == 20) {
+      // Removed article.
+      continue;
+    }
+    std::ostringstream url, data;
+    url << "section" << i%4 << "/article" << i;
+    data << "<html><body>Content of article " << i << " ";
+    for (auto j=0; j<i; j++) {
+      data << j << " ";
+    }
+    if (i%50 == 0) {
+      data << "Updated";
+    }
+    data << "</body></html>";
+    auto mimetype = (i%3) ? "text/html" : "text/css";
+    content["A/"+url.str()] = std::make_pair(mimetype, data.str());
+    creator.addArticle(std::make_shared<TestArticle>('A', url.str(), mimetype, data.str()));
+  }
+  ASSERT_LE(base.getClusterCacheMisses(), baseClusterMisses + base.getCountClusters());
+  creator.finishZimCreation();
+
+  zim::File file(zimFile.path);
+  ASSERT_TRUE(file.verify());
+  checkContent(file, content);
+  ASSERT_FALSE(file.getArticleByUrl("A/section0/article20").good());
+
+  std::set<std::string> baseClusters;
+  for (zim::cluster_index_type i=0; i<base.getCountClusters(); i++) {
+    baseClusters.insert(std::string(base.getRawCluster(i)));
+  }
+  unsigned copiedClusters = 0;
+  for (zim::cluster_index_type i=0; i<file.getCountClusters(); i++) {
+    copiedClusters += baseClusters.count(std::string(file.getRawCluster(i)));
+  }
+  ASSERT_GT(copiedClusters, 2U);
+  ASSERT_LT(copiedClusters, file.getCountClusters());
+}
+
+TEST(CreatorTest, transcode)
+{
+  TempZimFile sourceZimFile("test_creator");
+  Content content;
+  {
+    zim::writer::Creator creator(false, zim::zimcompLzma);
+    content = createZim(creator, sourceZimFile.path);
+  }
+  zim::File source(sourceZimFile.path);
+
+  TempZimFile zimFile("test_creator");
+  zim::writer::Transcoder transcoder(zim::zimcompZstd);
+  zim::CompressionOptions options;
+  options.level = 3;
+  transcoder.setCompressionOptions(options);
+  transcoder.transcode(source, zimFile.path);
+
+  zim::File file(zimFile.path);
+  ASSERT_TRUE(file.verify());
+  checkContent(file, content);
+  ASSERT_EQ(file.getFileheader().getUuid(), source.getFileheader().getUuid());
+  ASSERT_EQ(file.getCountArticles(), source.getCountArticles());
+  ASSERT_EQ(file.getCountClusters(), source.getCountClusters());
+  for (zim::article_index_type i=0; i<file.getCountArticles(); i++) {
+    ASSERT_EQ(file.getArticle(i).getLongUrl(), source.getArticle(i).getLongUrl());
+    ASSERT_EQ(file.getArticle(i).getClusterNumber(), source.getArticle(i).getClusterNumber());
+  }
+  for (zim::cluster_index_type i=0; i<file.getCountClusters(); i++) {
+    auto sourceCompression = source.getRawCluster(i).data()[0] & 0x0F;
+    auto compression = file.getRawCluster(i).data()[0] & 0x0F;
+    if (sourceCompression == zim::zimcompLzma) {
+      ASSERT_EQ(compression, zim::zimcompZstd);
+    } else {
+      ASSERT_EQ(compression, sourceCompression);
+    }
+  }
+}
+
+TEST(CreatorTest, stats)
+{
+  TempZimFile zimFile("test_creator");
+  zim::writer::Creator creator(false, zim::zimcompZstd);
+  ASSERT_EQ(creator.getStats().articles, 0U);
+  std::vector<zim::writer::CreatorStats> reports;
+  creator.setStatsCallback([&](const zim::writer::CreatorStats& stats) {
+    reports.push_back(stats);
+  }, std::chrono::milliseconds(0));
+  auto content = createZim(creator, zimFile.path);
+
+  ASSERT_GT(reports.size(), 200U);
+  for (auto i=1U; i<reports.size(); i++) {
+    ASSERT_GE(reports[i].articles, reports[i-1].articles);
+    ASSERT_GE(reports[i].writtenClusters, reports[i-1].writtenClusters);
+  }
+  auto stats = creator.getStats();
+  zim::size_type articlesSize = 0;
+  for (auto& entry: content) {
+    articlesSize += entry.second.second.size();
+  }
+  // The zim file also contains the articles created by the creator.
+  ASSERT_GT(stats.articles, content.size());
+  ASSERT_GT(stats.articlesSize, articlesSize);
+  ASSERT_EQ(stats.writtenClusters, stats.clusters);
+  ASSERT_EQ(stats.compressions[zim::zimcompZstd].clusters, stats.compressedClusters);
+  ASSERT_GT(stats.compressions[zim::zimcompZstd].rawSize,
+            stats.compressions[zim::zimcompZstd].compressedSize);
+  zim::cluster_index_type histogramClusters = 0;
+  for (auto count: stats.ratioHistogram) {
+    histogramClusters += count;
+  }
+  ASSERT_EQ(histogramClusters, stats.compressedClusters);
+  ASSERT_EQ(stats.waitingTasks, 0U);
+  ASSERT_EQ(stats.bytesInFlight, 0U);
+  ASSERT_GT(stats.compressionTime, 0);
+  ASSERT_EQ(reports.back().writtenClusters, stats.writtenClusters);
+}
+
+}  // namespace
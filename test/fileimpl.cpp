@@ -0,0 +1,228 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include <zim/article.h>
+#include <zim/file.h>
+#include <zim/writer/creator.h>
+
+#include "testzim.h"
+
+namespace
+{
+
+using namespace zim::unittests;
+
+TEST(FileImplTest, clusterCacheStatistics)
+{
+  TempZimFile zimFile("test_fileimpl");
+  zim::writer::Creator creator(false, zim::zimcompZstd);
+  auto content = createZim(creator, zimFile.path);
+
+  zim::File file(zimFile.path);
+  ASSERT_EQ(file.getClusterCacheHits(), 0U);
+  ASSERT_EQ(file.getClusterCacheMisses(), 0U);
+  file.getCluster(0);
+  ASSERT_EQ(file.getClusterCacheHits(), 0U);
+  ASSERT_EQ(file.getClusterCacheMisses(), 1U);
+  file.getCluster(0);
+  ASSERT_EQ(file.getClusterCacheHits(), 1U);
+  ASSERT_EQ(file.getClusterCacheMisses(), 1U);
+}
+
+TEST(FileImplTest, compressedClusterCache)
+{
+  TempZimFile zimFile("test_fileimpl");
+  zim::writer::Creator creator(false, zim::zimcompZstd);
+  auto content = createZim(creator, zimFile.path);
+
+  zim::File file(zimFile.path);
+  std::vector<zim::cluster_index_type> compressedClusters;
+  for (zim::cluster_index_type i = 0; i < file.getCountClusters(); ++i) {
+    file.getCluster(i);
+    auto compression = file.getRawCluster(i).data()[0] & 0x0F;
+    if (compression != zim::zimcompDefault && compression != zim::zimcompNone)
+      compressedClusters.push_back(i);
+  }
+  // More clusters than the (uncompressed) cluster cache can hold.
+  ASSERT_GT(compressedClusters.size(), 16U);
+  ASSERT_EQ(file.getCompressedClusterCacheHits(), 0U);
+  ASSERT_EQ(file.getCompressedClusterCacheMisses(), compressedClusters.size());
+  ASSERT_GT(file.getCompressedClusterCacheSize(), 0U);
+
+  // The first clusters have been evicted from the cluster cache, but not
+  // their compressed bytes.
+  auto misses = file.getClusterCacheMisses();
+  file.getCluster(compressedClusters[0]);
+  ASSERT_EQ(file.getClusterCacheMisses(), misses + 1);
+  ASSERT_EQ(file.getCompressedClusterCacheHits(), 1U);
+  ASSERT_EQ(file.getCompressedClusterCacheMisses(), compressedClusters.size());
+  checkContent(file, content);
+}
+
+TEST(FileImplTest, blobSizeWithoutUncompressing)
+{
+  // Streaming clusters have their offsets compressed in a stream of their own.
+  const std::vector<std::pair<zim::CompressionType, bool>> configs = {
+    {zim::zimcompNone, false},
+    {zim::zimcompLzma, false},
+    {zim::zimcompZstd, false},
+    {zim::zimcompZstd, true},
+  };
+  for (auto& config: configs) {
+    TempZimFile zimFile("test_fileimpl");
+    zim::writer::Creator creator(false, config.first);
+    creator.setStreamingCompression(config.second);
+    auto content = createZim(creator, zimFile.path);
+
+    zim::File file(zimFile.path);
+    for (auto& entry: content) {
+      auto article = file.getArticleByUrl(entry.first);
+      ASSERT_TRUE(article.good()) << entry.first;
+      ASSERT_EQ(article.getArticleSize(), entry.second.second.size()) << entry.first;
+    }
+    // Only the offsets of the clusters have been read.
+    ASSERT_EQ(file.getClusterCacheMisses(), 0U);
+    checkContent(file, content);
+  }
+}
+
+TEST(FileImplTest, parallelForEach)
+{
+  TempZimFile zimFile("test_fileimpl");
+  zim::writer::Creator creator(false, zim::zimcompZstd);
+  auto content = createZim(creator, zimFile.path);
+
+  zim::File file(zimFile.path);
+  for (auto nbThreads: {1U, 4U}) {
+    std::mutex lock;
+    Content seen;
+    file.parallelForEach([&](const zim::Article& article, const zim::Blob& data) {
+      std::lock_guard<std::mutex> guard(lock);
+      ASSERT_EQ(seen.count(article.getLongUrl()), 0U);
+      seen[article.getLongUrl()] = std::make_pair(article.getMimeType(), std::string(data));
+    }, nbThreads);
+    ASSERT_EQ(seen.size(), file.getCountArticles());
+    for (auto& entry: content) {
+      ASSERT_EQ(seen[entry.first], entry.second) << entry.first;
+    }
+  }
+  // The clusters are not read through the cluster cache.
+  ASSERT_EQ(file.getClusterCacheMisses(), 0U);
+
+  std::atomic<unsigned> calls(0);
+  ASSERT_THROW(file.parallelForEach([&](const zim::Article&, const zim::Blob&) {
+    if (++calls == 10)
+      throw std::runtime_error("stop");
+  }), std::runtime_error);
+  ASSERT_LT(calls.load(), file.getCountArticles());
+}
+
+TEST(FileImplTest, cacheState)
+{
+  TempZimFile zimFile("test_fileimpl");
+  zim::writer::Creator creator(false, zim::zimcompZstd);
+  auto content = createZim(creator, zimFile.path);
+  TempFile stateFile("test_cache_state");
+
+  std::vector<std::string> urls;
+  {
+    zim::File file(zimFile.path);
+    for (auto& entry: content) {
+      if (urls.size() == 3)
+        break;
+      ASSERT_EQ(std::string(file.getArticleByUrl(entry.first).getData()), entry.second.second);
+      urls.push_back(entry.first);
+    }
+    file.saveCacheState(stateFile.path());
+  }
+
+  zim::File file(zimFile.path);
+  ASSERT_TRUE(file.loadCacheState(stateFile.path()));
+  file.waitCacheState();
+  auto misses = file.getClusterCacheMisses();
+  ASSERT_GT(misses, 0U);
+  // The clusters have been preloaded.
+  for (auto& url: urls) {
+    ASSERT_EQ(std::string(file.getArticleByUrl(url).getData()), content[url].second);
+  }
+  ASSERT_EQ(file.getClusterCacheMisses(), misses);
+
+  // Several threads can load and wait for the cache state of a shared file.
+  std::vector<std::thread> threads;
+  for (auto i = 0; i < 4; ++i) {
+    threads.emplace_back([&file, &stateFile, i]() {
+      if (i % 2)
+        file.loadCacheState(stateFile.path());
+      file.waitCacheState();
+    });
+  }
+  for (auto& thread: threads) {
+    thread.join();
+  }
+
+  // A cache state of another zim file is ignored.
+  TempZimFile otherZimFile("test_fileimpl");
+  zim::writer::Creator otherCreator(false, zim::zimcompZstd);
+  createZim(otherCreator, otherZimFile.path);
+  zim::File otherFile(otherZimFile.path);
+  ASSERT_FALSE(otherFile.loadCacheState(stateFile.path()));
+  ASSERT_FALSE(otherFile.loadCacheState(stateFile.path() + ".missing"));
+}
+
+TEST(FileImplTest, cacheMaxSize)
+{
+  TempZimFile zimFile("test_fileimpl");
+  zim::writer::Creator creator(false, zim::zimcompZstd);
+  auto content = createZim(creator, zimFile.path);
+
+  auto defaultClusterCacheSize = zim::getDefaultClusterCacheMaxSize();
+  zim::setDefaultClusterCacheMaxSize(2);
+  zim::File file(zimFile.path);
+  zim::setDefaultClusterCacheMaxSize(defaultClusterCacheSize);
+  ASSERT_EQ(file.getClusterCacheMaxSize(), 2U);
+  ASSERT_EQ(zim::File(zimFile.path).getClusterCacheMaxSize(), defaultClusterCacheSize);
+
+  file.setClusterCacheMaxSize(3);
+  file.getCluster(0);
+  file.getCluster(1);
+  file.getCluster(2);
+  ASSERT_EQ(file.getClusterCacheMisses(), 3U);
+  // Shrinking evicts the least recently used clusters right away.
+  file.setClusterCacheMaxSize(1);
+  file.getCluster(2);
+  file.getCluster(1);
+  ASSERT_EQ(file.getClusterCacheHits(), 1U);
+  ASSERT_EQ(file.getClusterCacheMisses(), 4U);
+
+  file.setDirentCacheMaxSize(10);
+  ASSERT_EQ(file.getDirentCacheMaxSize(), 10U);
+  file.setCompressedClusterCacheMaxSize(0);
+  ASSERT_EQ(file.getCompressedClusterCacheMaxSize(), 0U);
+  ASSERT_EQ(file.getCompressedClusterCacheSize(), 0U);
+  checkContent(file, content);
+}
+
+}  // namespace
@@ -100,4 +100,34 @@ TEST(FindTests, ByURLDefaultNS)
     ASSERT_EQ(article2->getIndex(), 2);
 }
 
+// Batch
+TEST(FindTests, Batch)
+{
+    zim::File file ("./data/wikibooks_be_all_nopic_2017-02.zim");
+
+    std::vector<std::string> urls;
+    for (zim::article_index_type i = file.getCountArticles(); i > 0; --i) {
+        urls.push_back(file.getArticle(i-1).getLongUrl());
+    }
+    urls.push_back("A/Main_Page.html");
+    urls.push_back("/-/j/head.js");
+    urls.push_back("unkwonUrl");
+    urls.push_back("A/unkwonUrl");
+    urls.push_back("Z/unkwonUrl");
+    urls.push_back("");
+
+    auto articles = file.findBatch(urls);
+    ASSERT_EQ(articles.size(), urls.size());
+    for (size_t i = 0; i < urls.size(); ++i) {
+        auto expected = file.getArticleByUrl(urls[i]);
+        ASSERT_EQ(articles[i].good(), expected.good()) << urls[i];
+        if (expected.good()) {
+            ASSERT_EQ(articles[i].getIndex(), expected.getIndex()) << urls[i];
+        }
+    }
+    ASSERT_EQ(articles[urls.size()-6].getIndex(), 5U);
+    ASSERT_EQ(articles[urls.size()-5].getIndex(), 2U);
+    ASSERT_FALSE(articles[urls.size()-4].good());
+}
+
 } // namespace
@@ -21,6 +21,7 @@
 #include <zim/file.h>
 #include <zim/error.h>
 #include <zim/fileiterator.h>
+#include <zim/dirent_scanner.h>
 
 #include "gtest/gtest.h"
 
@@ -122,4 +123,52 @@ TEST(IteratorTests, beginByUrl)
     }
 }
 
+TEST(DirentScannerTest, scan)
+{
+    for (auto path: {"./data/wikibooks_be_all_nopic_2017-02.zim",
+                     "./data/wikibooks_be_all_nopic_2017-02_splitted.zim"}) {
+        zim::File file (path);
+        // A small chunk size forces the dirents to be read in several chunks.
+        for (zim::size_type chunkSize: {1024*1024, 256}) {
+            zim::DirentScanner scanner(file, 0, std::numeric_limits<zim::article_index_type>::max(), chunkSize);
+            zim::article_index_type count = 0;
+            while (scanner.next()) {
+                auto article = file.getArticle(count);
+                ASSERT_EQ(scanner.getIndex(), count);
+                ASSERT_EQ(scanner.getLongUrl(), article.getLongUrl());
+                ASSERT_EQ(scanner.getTitle(), article.getTitle());
+                ASSERT_EQ(scanner.getParameter(), article.getParameter());
+                ASSERT_EQ(scanner.isRedirect(), article.isRedirect());
+                if (article.isRedirect()) {
+                    ASSERT_EQ(scanner.getRedirectIndex(), article.getRedirectIndex());
+                } else {
+                    ASSERT_EQ(scanner.getMimeType(), article.getMimeType());
+                    ASSERT_EQ(scanner.getClusterNumber(), article.getClusterNumber());
+                    ASSERT_EQ(scanner.getBlobNumber(), article.getBlobNumber());
+                }
+                ASSERT_EQ(scanner.getArticle().getIndex(), count);
+                ++count;
+            }
+            ASSERT_EQ(count, file.getCountArticles());
+            ASSERT_FALSE(scanner.next());
+        }
+    }
+}
+
+TEST(DirentScannerTest, range)
+{
+    zim::File file ("./data/wikibooks_be_all_nopic_2017-02.zim");
+
+    zim::DirentScanner scanner(file, 10, 20);
+    for (zim::article_index_type i = 10; i < 20; ++i) {
+        ASSERT_TRUE(scanner.next());
+        ASSERT_EQ(scanner.getIndex(), i);
+        ASSERT_EQ(scanner.getLongUrl(), file.getArticle(i).getLongUrl());
+    }
+    ASSERT_FALSE(scanner.next());
+
+    zim::DirentScanner empty(file, file.getCountArticles());
+    ASSERT_FALSE(empty.next());
+}
+
 } // namespace
@@ -60,6 +60,22 @@ TEST(CacheTest, MissingValue) {
     EXPECT_THROW(cache_lru.get(7).value(), std::range_error);
 }
 
+TEST(CacheTest, Statistics) {
+    zim::lru_cache<int, int> cache_lru(2);
+    EXPECT_EQ(0U, cache_lru.getHits());
+    EXPECT_EQ(0U, cache_lru.getMisses());
+    EXPECT_EQ(0, cache_lru.hitRatio());
+    cache_lru.put(7, 777);
+    EXPECT_TRUE(cache_lru.get(7).hit());
+    EXPECT_TRUE(cache_lru.get(8).miss());
+    EXPECT_TRUE(cache_lru.getOrPut(8, 888).miss());
+    EXPECT_TRUE(cache_lru.getOrPut(8, 888).hit());
+    EXPECT_EQ(2U, cache_lru.getHits());
+    EXPECT_EQ(2U, cache_lru.getMisses());
+    EXPECT_EQ(0.5, cache_lru.hitRatio());
+    EXPECT_EQ(1, cache_lru.fillfactor());
+}
+
 TEST(CacheTest1, KeepsAllValuesWithinCapacity) {
     zim::lru_cache<int, int> cache_lru(TEST2_CACHE_CAPACITY);
 
@@ -79,3 +95,41 @@ TEST(CacheTest1, KeepsAllValuesWithinCapacity) {
     size_t size = cache_lru.size();
     EXPECT_EQ(TEST2_CACHE_CAPACITY, size);
 }
+
+TEST(CacheTest, Cost) {
+    zim::lru_cache<int, int> cache_lru(10);
+    cache_lru.put(1, 111, 4);
+    cache_lru.put(2, 222, 4);
+    EXPECT_EQ(8U, cache_lru.cost());
+    EXPECT_EQ(0.8, cache_lru.fillfactor());
+    EXPECT_TRUE(cache_lru.get(1).hit());
+    // 2 is the least recently used.
+    cache_lru.put(3, 333, 4);
+    EXPECT_TRUE(cache_lru.exists(1));
+    EXPECT_FALSE(cache_lru.exists(2));
+    EXPECT_TRUE(cache_lru.exists(3));
+    EXPECT_EQ(8U, cache_lru.cost());
+    cache_lru.put(3, 333, 2);
+    EXPECT_EQ(6U, cache_lru.cost());
+    // Too costly to be kept at all.
+    cache_lru.put(4, 444, 11);
+    EXPECT_FALSE(cache_lru.exists(4));
+    EXPECT_EQ(0U, cache_lru.size());
+    EXPECT_EQ(0U, cache_lru.cost());
+}
+
+TEST(CacheTest, SetMaxSize) {
+    zim::lru_cache<int, int> cache_lru(4);
+    for (int i = 0; i < 4; ++i) {
+        cache_lru.put(i, i);
+    }
+    EXPECT_EQ(4U, cache_lru.getMaxSize());
+    cache_lru.setMaxSize(2);
+    EXPECT_EQ(2U, cache_lru.getMaxSize());
+    EXPECT_EQ(2U, cache_lru.size());
+    EXPECT_TRUE(cache_lru.exists(2));
+    EXPECT_TRUE(cache_lru.exists(3));
+    cache_lru.setMaxSize(3);
+    cache_lru.put(4, 4);
+    EXPECT_EQ(3U, cache_lru.size());
+}
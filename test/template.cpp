@@ -75,4 +75,32 @@ TEST_F(TemplateTest, Link)
   ASSERT_EQ(result, "<html>L(A, Article)</html>");
 }
 
+TEST(CompiledTemplateTest, Segments)
+{
+  const std::string data = "<html a<b><%title%><%/A/Article%>100%> <%foo%><%/B/Missing%>";
+  zim::CompiledTemplate compiled(data.data(), data.size());
+  compiled.resolveLinks([](char ns, const std::string& url) {
+    return std::make_pair(ns == 'A', zim::article_index_type(42));
+  });
+
+  auto& segments = compiled.getSegments();
+  ASSERT_EQ(segments.size(), 6U);
+  ASSERT_EQ(segments[0].type, zim::CompiledTemplate::DATA);
+  ASSERT_EQ(segments[0].data, "<html a<b>");
+  ASSERT_EQ(segments[1].type, zim::CompiledTemplate::TOKEN);
+  ASSERT_EQ(segments[1].token, zim::CompiledTemplate::TITLE);
+  ASSERT_EQ(segments[2].type, zim::CompiledTemplate::LINK);
+  ASSERT_EQ(segments[2].ns, 'A');
+  ASSERT_EQ(segments[2].data, "Article");
+  ASSERT_TRUE(segments[2].found);
+  ASSERT_EQ(segments[2].index, 42U);
+  ASSERT_EQ(segments[3].type, zim::CompiledTemplate::DATA);
+  ASSERT_EQ(segments[3].data, "100%> ");
+  ASSERT_EQ(segments[4].type, zim::CompiledTemplate::TOKEN);
+  ASSERT_EQ(segments[4].token, zim::CompiledTemplate::UNKNOWN);
+  ASSERT_EQ(segments[4].data, "foo");
+  ASSERT_EQ(segments[5].type, zim::CompiledTemplate::LINK);
+  ASSERT_FALSE(segments[5].found);
+}
+
 }  // namespace
@@ -0,0 +1,139 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef ZIM_TEST_TESTZIM_H
+#define ZIM_TEST_TESTZIM_H
+
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include <stdio.h>
+
+#include "gtest/gtest.h"
+
+#include <zim/file.h>
+#include <zim/writer/creator.h>
+
+#include "tempfile.h"
+
+namespace zim
+{
+
+namespace unittests
+{
+
+// Helpers for the tests creating a zim file and reading it back.
+
+class TestArticle : public zim::writer::Article
+{
+  public:
+    TestArticle(char ns, const std::string& url, const std::string& mimetype,
+                const std::string& data, bool compress = true)
+      : url(ns, url),
+        mimetype(mimetype),
+        data(data),
+        compress(compress)
+    {}
+
+    zim::writer::Url getUrl() const { return url; }
+    std::string getTitle() const { return url.getUrl(); }
+    bool isRedirect() const { return false; }
+    std::string getMimeType() const { return mimetype; }
+    bool shouldCompress() const { return compress; }
+    bool shouldIndex() const { return false; }
+    zim::writer::Url getRedirectUrl() const { return zim::writer::Url(); }
+    zim::size_type getSize() const { return data.size(); }
+    zim::Blob getData() const { return zim::Blob(data.data(), data.size()); }
+    std::string getFilename() const { return ""; }
+
+  private:
+    zim::writer::Url url;
+    std::string mimetype;
+    std::string data;
+    bool compress;
+};
+
+// An article whose content is read by the creator from a file.
+class TestFileArticle : public TestArticle
+{
+  public:
+    TestFileArticle(char ns, const std::string& url, const std::string& mimetype,
+                    const std::string& data, const std::string& filename, bool compress)
+      : TestArticle(ns, url, mimetype, data, compress),
+        filename(filename)
+    {}
+
+    std::string getFilename() const { return filename; }
+
+  private:
+    std::string filename;
+};
+
+// A zim file created in the temporary directory and removed at the end.
+class TempZimFile
+{
+  public:
+    explicit TempZimFile(const char* name)
+      : tmpFile(name),
+        path(tmpFile.path() + ".zim")
+    {}
+    ~TempZimFile() { remove(path.c_str()); }
+
+    TempFile tmpFile;
+    const std::string path;
+};
+
+typedef std::map<std::string, std::pair<std::string, std::string>> Content;
+
+inline Content createZim(zim::writer::Creator& creator, const std::string& path)
+{
+  Content content;
+  creator.setMinChunkSize(4);
+  creator.startZimCreation(path);
+  for (auto i=0; i<200; i++) {
+    std::ostringstream url, data;
+    url << "section" << i%4 << "/article" << i;
+    data << "<html><body>Content of article " << i << " ";
+    for (auto j=0; j<i; j++) {
+      data << j << " ";
+    }
+    data << "</body></html>";
+    auto mimetype = (i%3) ? "text/html" : "text/css";
+    content["A/"+url.str()] = std::make_pair(mimetype, data.str());
+    creator.addArticle(std::make_shared<TestArticle>('A', url.str(), mimetype, data.str()));
+  }
+  creator.finishZimCreation();
+  return content;
+}
+
+inline void checkContent(const zim::File& file, const Content& content)
+{
+  for (auto& entry: content) {
+    auto article = file.getArticleByUrl(entry.first);
+    ASSERT_TRUE(article.good()) << entry.first;
+    ASSERT_EQ(article.getMimeType(), entry.second.first);
+    ASSERT_EQ(std::string(article.getData()), entry.second.second);
+  }
+}
+
+} // namespace unittests
+
+} // namespace zim
+
+#endif // ZIM_TEST_TESTZIM_H
@@ -0,0 +1,153 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * is provided AS IS, WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, and
+ * NON-INFRINGEMENT.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unicode/translit.h>
+#include <unicode/ucnv.h>
+
+#include "gtest/gtest.h"
+
+#include "../src/tools.h"
+
+namespace
+{
+
+// The plain ICU implementation, which removeAccents must be equivalent to.
+std::string referenceRemoveAccents(const std::string& text)
+{
+  ucnv_setDefaultName("UTF-8");
+  UErrorCode status = U_ZERO_ERROR;
+  std::unique_ptr<icu::Transliterator> trans(icu::Transliterator::createInstance(
+      "Lower; NFD; [:M:] remove; NFC", UTRANS_FORWARD, status));
+  icu::UnicodeString ustring(text.c_str());
+  trans->transliterate(ustring);
+  std::string unaccentedText;
+  ustring.toUTF8String(unaccentedText);
+  return unaccentedText;
+}
+
+std::string utf8(uint32_t c)
+{
+  icu::UnicodeString ustring(static_cast<UChar32>(c));
+  std::string s;
+  ustring.toUTF8String(s);
+  return s;
+}
+
+const std::vector<std::string> texts = {
+  "",
+  "Hello World",
+  "An ASCII text long enough to be checked by words: 0123456789 ~!@#$%^&*()",
+  "Élégant Château",
+  "Ça coûte ÉNORMÉMENT, n'est-ce pas ?",
+  "Straße İstanbul Łódź Øresund Ærø Œuvre",
+  "Zuërich na\xcc\x88ive",       // combining diaeresis
+  "Ελληνικά ΣΟΦΟΣ",             // Greek, not in the latin table
+  "Привет, Мир",
+  "日本語のテキスト",
+  "emoji \xf0\x9f\x98\x80 É",
+  "invalid \xc3 utf8 \xff\xfe É",
+  "truncated \xe1\x80 É",
+  std::string("null\0character", 14),
+};
+
+TEST(ToolsTest, removeAccents)
+{
+  for (auto& text: texts) {
+    ASSERT_EQ(zim::removeAccents(text), referenceRemoveAccents(text)) << text;
+  }
+}
+
+TEST(ToolsTest, removeAccentsLatinTable)
+{
+  for (uint32_t c = 0x80; c < 0x370; ++c) {
+    auto text = "A" + utf8(c) + "b" + utf8(c);
+    ASSERT_EQ(zim::removeAccents(text), referenceRemoveAccents(text)) << c;
+    text = "e" + utf8(c) + "\xcc\x81";
+    ASSERT_EQ(zim::removeAccents(text), referenceRemoveAccents(text)) << c;
+  }
+}
+
+TEST(ToolsTest, removeAccentsThreads)
+{
+  std::vector<std::string> expected;
+  for (auto& text: texts) {
+    expected.push_back(referenceRemoveAccents(text + "Ω"));
+  }
+  std::vector<std::thread> threads;
+  std::vector<int> failures(4, 0);
+  for (auto i = 0U; i < failures.size(); ++i) {
+    threads.emplace_back([i, &failures, &expected]() {
+      for (auto j = 0; j < 100; ++j) {
+        for (auto k = 0U; k < texts.size(); ++k) {
+          if (zim::removeAccents(texts[k] + "Ω") != expected[k])
+            failures[i]++;
+        }
+      }
+    });
+  }
+  for (auto& thread: threads) {
+    thread.join();
+  }
+  for (auto failure: failures) {
+    ASSERT_EQ(failure, 0);
+  }
+}
+
+// Run with --gtest_also_run_disabled_tests to compare the speed with the
+// plain ICU implementation.
+TEST(ToolsTest, DISABLED_removeAccentsBenchmark)
+{
+  std::string text;
+  for (auto i = 0; i < 1000; ++i) {
+    text += texts[i % 6] + " ";
+  }
+  ucnv_setDefaultName("UTF-8");
+  UErrorCode status = U_ZERO_ERROR;
+  std::unique_ptr<icu::Transliterator> trans(icu::Transliterator::createInstance(
+      "Lower; NFD; [:M:] remove; NFC", UTRANS_FORWARD, status));
+
+  const auto nbRuns = 100;
+  auto start = std::chrono::steady_clock::now();
+  for (auto i = 0; i < nbRuns; ++i) {
+    icu::UnicodeString ustring(text.c_str());
+    trans->transliterate(ustring);
+    std::string unaccentedText;
+    ustring.toUTF8String(unaccentedText);
+  }
+  auto icuTime = std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  for (auto i = 0; i < nbRuns; ++i) {
+    zim::removeAccents(text);
+  }
+  auto fastTime = std::chrono::steady_clock::now() - start;
+
+  std::cout << "ICU: "
+            << std::chrono::duration_cast<std::chrono::microseconds>(icuTime).count()
+            << "us, removeAccents: "
+            << std::chrono::duration_cast<std::chrono::microseconds>(fastTime).count()
+            << "us" << std::endl;
+}
+
+}  // namespace